@@ -8,8 +8,10 @@
 #include <stdbool.h> // for bool
 #include <stddef.h>  // for size_t
 
-// Alignment requirement for all blocks
+// Alignment requirement for all blocks, a build can ask for more with -DALIGNMENT=16
+#ifndef ALIGNMENT
 #define ALIGNMENT 8
+#endif
 
 // maximum size of block that must be accommodated
 #define MAX_REQUEST_SIZE (1 << 30)
@@ -34,6 +36,25 @@ bool myinit(void *heap_start, size_t heap_size);
 void *mymalloc(size_t requested_size);
 
 
+/* Function: mymemalign
+ * --------------------
+ * Custom version of memalign.  Returns a block of requested_size bytes
+ * that starts at a multiple of alignment, which must be a power of two.
+ * The block is freed with myfree like any other.  Returns NULL if
+ * alignment is not a power of two or there is no room.
+ */
+void *mymemalign(size_t alignment, size_t requested_size);
+
+
+/* Function: mycalloc
+ * ------------------
+ * Custom version of calloc.  Returns a block of nmemb * size bytes that are
+ * all zero, or NULL if that product is 0, overflows or there is no room.
+ * Memory the allocator knows is still zero is not cleared again.
+ */
+void *mycalloc(size_t nmemb, size_t size);
+
+
 /* Function: myrealloc
  * -------------------
  * Custom version of realloc.
@@ -48,6 +69,74 @@ void *myrealloc(void *old_ptr, size_t new_size);
 void myfree(void *ptr);
 
 
+/* Function: myfree_sized
+ * -----------------------
+ * Custom version of free for callers that know the size of the block, like
+ * C++ sized deallocation.  size must be the size the block was requested
+ * with, or any size up to what mymalloc_usable_size returns for it.  A
+ * block from mymemalign is freed with myfree, because its size need not
+ * tell where its block starts or how big it is.
+ */
+void myfree_sized(void *ptr, size_t size);
+
+
+/* Function: mymalloc_usable_size
+ * ------------------------------
+ * Returns the number of bytes the caller can use in the allocated block at
+ * ptr, which is at least the size it was requested with, or 0 if ptr is
+ * NULL or the allocator does not keep track of block sizes.  The bytes past
+ * the requested size can be used without calling myrealloc.
+ */
+size_t mymalloc_usable_size(void *ptr);
+
+
+/* Function: mymalloc_batch
+ * ------------------------
+ * Allocates count blocks of size bytes each and stores pointers to them
+ * in out[0..count-1].  Returns the number of blocks allocated; if the heap
+ * runs out part way, the entries after the last block are set to NULL.
+ * The blocks may be carved from the heap together, which is cheaper than
+ * count separate calls to mymalloc.
+ */
+size_t mymalloc_batch(size_t size, size_t count, void *out[]);
+
+
+/* Function: myfree_batch
+ * ----------------------
+ * Frees the count blocks in ptrs, ignoring NULL entries, as if myfree were
+ * called on each.  The order of the entries in ptrs may be changed.
+ */
+void myfree_batch(void *ptrs[], size_t count);
+
+
+// Counters describing an allocator, kept up to date as it runs
+typedef struct {
+    size_t allocated_bytes;  // usable bytes of the blocks handed out and not yet freed
+    size_t free_bytes;       // payload bytes of the free blocks of the heap
+    size_t free_blocks;      // number of free blocks of the heap
+    size_t largest_free;     // payload bytes of the largest free block, or an upper bound, see allocator_stats
+    size_t mallocs;          // blocks handed out by mymalloc, mycalloc, mymemalign and mymalloc_batch
+    size_t frees;            // blocks given back by myfree, myfree_sized and myfree_batch
+    size_t reallocs;         // calls to myrealloc that resized a block
+    size_t search_steps;     // blocks or tree nodes looked at while searching for a fit
+} allocator_stats_t;
+
+
+/* Function: allocator_stats
+ * -------------------------
+ * Returns the allocator's counters.  They are updated by each call as it
+ * runs, so this takes constant time (or a walk down the free block index)
+ * and never walks the heap or a free list.  largest_free is exact when the
+ * index keeps blocks in size order or a size class holds a single size,
+ * and otherwise it is the largest size the highest non-empty class can
+ * hold, an upper bound on the largest free block.  A myrealloc that moves
+ * the block counts as one malloc and one free as well as a realloc, and
+ * myrealloc with a NULL pointer or a size of 0 counts only as a malloc or
+ * a free.  The counters start over at myinit.
+ */
+allocator_stats_t allocator_stats();
+
+
 /* Function: validate_heap
  * -----------------------
  * This is the hook for your heap consistency checker. Returns true
@@ -0,0 +1,529 @@
+/* CS 107
+Code written by: Christo Hristov
+
+This file contains a series of utility functions implemented to allocate, free, and reallocate memory from a heap using a binary buddy system.  These functions are used in the test_buddy.c file.
+
+Every block holds 2^order bytes, including its header, and starts at an offset from the start of the heap that is a multiple of its size.  A block is split into two halves called buddies, and since the offsets of two buddies differ only in the bit for their size, the buddy of a block is found by XORing its offset with its size.  When a block is freed, it is merged with its buddy for as long as the buddy is also free and whole, so splitting and merging both take at most one step per order.
+
+A payload normally starts right after the header of its block.  mymemalign instead takes a block with room for the alignment as well, and starts the payload at the first aligned address after the header, with the word before it giving the distance back to the header.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "./allocator.h"
+#include "./debug_break.h"
+
+#define HEADER_SIZE 8  // define a constant to hold the number of bytes in a header
+#define MIN_ORDER 5  // smallest block is 32 bytes, enough for a header and a free list node
+#define MAX_ORDER 40  // largest block is 1 TiB
+#define USED_BIT 1  // bit of the header that is set when the block is used
+#define ALIGNED_BIT 2  // bit of the word before a payload that is set when it holds the distance back to the header
+
+static void *segment_start;
+static size_t segment_size;
+static size_t heap_used;  // bytes at the start of the segment covered by blocks, a multiple of 2^MIN_ORDER
+static void *free_lists[MAX_ORDER + 1];  // first node of the free list of each order, or NULL if it is empty
+static unsigned long nonempty_orders;  // bit i is set if free_lists[i] contains at least one free block
+static allocator_stats_t stats;  // counters returned by allocator_stats, largest_free is filled in when asked
+
+// create a struct, header, to hold the order of the block of memory indicated by the header
+typedef struct {
+    size_t info;  // the order of the block shifted left by two, with the low bit set if the block is used
+} header;
+
+// create a struct to hold a node in the free linked list of an order
+typedef struct {
+    void *next;  // pointer to next node in list
+    void *prev;  // pointer to previous node in list
+} node;
+
+/* Function: get_order
+-------------------------------
+Given a void pointer, headerptr, get_order returns the order of the block indicated by the header.
+
+This function assumes that headerptr points to a header in the heap.
+*/
+
+int get_order(void *headerptr) {
+    return ((header *)headerptr)->info >> 2;
+}
+
+/* Function: is_free
+-------------------------------
+Given a void pointer, headerptr, is_free returns true if headerptr points to a header that indicates a free block, and false if it indicates a used block.
+
+This function assumes that headerptr points to a header in the heap.
+*/
+
+bool is_free(void *headerptr) {
+    return (((header *)headerptr)->info & USED_BIT) == 0;
+}
+
+/* Function: get_location
+-------------------------------
+Given a pointer to a payload, ptr, get_location returns a pointer to the header of its block.  The word before the payload is the header, unless it has ALIGNED_BIT set, in which case it holds the distance from the header to ptr.
+
+This function assumes that ptr points to the payload of a used block.
+*/
+
+void *get_location(void *ptr) {
+    size_t info = ((header *)((char *)ptr - HEADER_SIZE))->info;
+    if ((info & ALIGNED_BIT) != 0) {
+        return (char *)ptr - (info & ~(size_t)ALIGNED_BIT);
+    }
+    return (char *)ptr - HEADER_SIZE;
+}
+
+/* Function: order_for
+-------------------------------
+Given a number of payload bytes, size, order_for returns the smallest order whose blocks can hold size bytes and a header.
+*/
+
+int order_for(size_t size) {
+    size_t total = size + HEADER_SIZE;
+    int order = MIN_ORDER;
+    // while blocks of this order are too small
+    while (((size_t)1 << order) < total) {
+        order++;
+    }
+    return order;
+}
+
+/* Function: get_buddy
+-------------------------------
+Given a pointer to the header of a block, location, and its order, order, get_buddy returns a pointer to where the buddy of the block starts, or NULL if the buddy would lie past the memory covered by blocks.
+*/
+
+void *get_buddy(void *location, int order) {
+    size_t offset = (char *)location - (char *)segment_start;
+    size_t buddy_offset = offset ^ ((size_t)1 << order);
+    if (buddy_offset + ((size_t)1 << order) > heap_used) {
+        return NULL;
+    }
+    return (char *)segment_start + buddy_offset;
+}
+
+/* Function: make_free
+----------------------------------
+Given a pointer to where we want a free block, location, and the order of the block, order, make_free will make a free block at location with the indicated order, push it onto the front of the free list of that order and count it in stats.
+*/
+
+void make_free(void *location, int order) {
+    ((header *)location)->info = (size_t)order << 2;
+    node *new_node = (node *)((char *)location + HEADER_SIZE);
+    new_node->next = free_lists[order];
+    new_node->prev = NULL;
+    // if there is a next block in the linked list
+    if (free_lists[order] != NULL) {
+        ((node *)free_lists[order])->prev = new_node;
+    }
+    free_lists[order] = new_node;
+    nonempty_orders |= 1UL << order;
+    stats.free_blocks++;
+    stats.free_bytes += ((size_t)1 << order) - HEADER_SIZE;
+}
+
+/* Function: remove_free
+------------------------------
+Given a pointer to the header of a free block, location, remove_free will remove the block from the free list of its order and stop counting it in stats.
+*/
+
+void remove_free(void *location) {
+    int order = get_order(location);
+    node *cur = (node *)((char *)location + HEADER_SIZE);
+    node *next_block = (node *)(cur->next);
+    node *prev_block = (node *)(cur->prev);
+    if (prev_block != NULL) {
+        prev_block->next = next_block;
+        // if we are removing the first node of the list
+    } else {
+        free_lists[order] = next_block;
+        if (next_block == NULL) {
+            nonempty_orders &= ~(1UL << order);
+        }
+    }
+    if (next_block != NULL) {
+        next_block->prev = prev_block;
+    }
+    stats.free_blocks--;
+    stats.free_bytes -= ((size_t)1 << order) - HEADER_SIZE;
+}
+
+/* Function: make_used
+-----------------------------
+Given a pointer to a header, location, and the order of the block, order, make_used will change the header to indicate a used block of that order.
+*/
+
+void make_used(void *location, int order) {
+    ((header *)location)->info = ((size_t)order << 2) | USED_BIT;
+}
+
+/* Function: merge_free
+-----------------------------
+Given a pointer to the header of a block that is not on any free list, location, and its order, order, merge_free merges the block with its buddy for as long as the buddy is a free block of the same order, and pushes the resulting block onto the free list of its order.
+*/
+
+void merge_free(void *location, int order) {
+    while (order < MAX_ORDER) {
+        void *buddy = get_buddy(location, order);
+        // the buddy can only be merged if it is free and has not been split
+        if (buddy == NULL || !is_free(buddy) || get_order(buddy) != order) {
+            break;
+        }
+        remove_free(buddy);
+        // the merged block starts at whichever buddy comes first
+        if (buddy < location) {
+            location = buddy;
+        }
+        order++;
+    }
+    make_free(location, order);
+}
+
+/* Function: myinit
+------------------------------
+Given a pointer to the start of the heap, heap_start, and the size of the heap, heap_size, myinit intializes heap_size bytes of memory starting at heap_start to be used as the heap.  The heap is covered by free blocks of decreasing powers of two, so every block starts at a multiple of its size from heap_start.  Any bytes at the end that are too few for the smallest block are left unused.  myinit will return false if the heap is too small to hold a single block, and otherwise will return true.
+
+This function assumes that heap_start is a non null pointer that is alligned with the ALIGNMENT constant.
+*/
+
+bool myinit(void *heap_start, size_t heap_size) {
+    if (heap_size < ((size_t)1 << MIN_ORDER)) {
+        return false;
+    }
+    segment_start = heap_start;
+    segment_size = heap_size;
+    memset(free_lists, 0, sizeof(free_lists));
+    nonempty_orders = 0;
+    heap_used = 0;
+    memset(&stats, 0, sizeof(stats));
+    // cover the heap with the largest blocks that fit, from the biggest order down
+    for (int order = MAX_ORDER; order >= MIN_ORDER; order--) {
+        if (heap_size - heap_used >= ((size_t)1 << order)) {
+            void *location = (char *)segment_start + heap_used;
+            heap_used += (size_t)1 << order;
+            make_free(location, order);
+        }
+    }
+    return true;
+}
+
+/* Function: alloc_order
+--------------------------
+Given an order, order, alloc_order returns a pointer to the header of a used block of that order, or NULL if there is no free block big enough.  The smallest free block of a big enough order is split in half until it is the order needed, and each upper half that is split off is added to the free list of its order.
+*/
+
+void *alloc_order(int order) {
+    unsigned long fits = nonempty_orders & (~0UL << order);  // orders with a free block big enough
+    if (fits == 0) {
+        return NULL;
+    }
+    int cur_order = __builtin_ctzl(fits);
+    void *location = (char *)free_lists[cur_order] - HEADER_SIZE;
+    remove_free(location);
+    // split the block in half until it is the order we need
+    while (cur_order > order) {
+        cur_order--;
+        make_free((char *)location + ((size_t)1 << cur_order), cur_order);
+    }
+    make_used(location, order);
+    stats.mallocs++;
+    stats.allocated_bytes += ((size_t)1 << order) - HEADER_SIZE;
+    return location;
+}
+
+/* Function: mymalloc
+--------------------------
+Given a number of bytes, requested_size, mymalloc will return a pointer to an adress in the heap that contains an alligned requested_size number of bytes to be used by the caller, in a block of the smallest order that fits it.  If the requested_size is 0 or there is not enough free memory in the heap to accomodate the user's request, mymalloc will return a null pointer.
+*/
+
+void *mymalloc(size_t requested_size) {
+    if (requested_size == 0 || requested_size > MAX_REQUEST_SIZE) {
+        return NULL;
+    }
+    void *location = alloc_order(order_for(requested_size));
+    return (location == NULL) ? NULL : (char *)location + HEADER_SIZE;
+}
+
+/* Function: mycalloc
+------------------------------------
+Given a number of elements, nmemb, and the size of each, size, mycalloc returns a pointer to a block of nmemb * size bytes that are all zero, or NULL if the product is 0, too big or does not fit in the heap.  Free blocks do not record whether they are zero, so the block is cleared with memset.
+*/
+
+void *mycalloc(size_t nmemb, size_t size) {
+    if (nmemb == 0 || size == 0 || nmemb > MAX_REQUEST_SIZE / size) {
+        return NULL;
+    }
+    void *result = mymalloc(nmemb * size);
+    if (result != NULL) {
+        memset(result, 0, nmemb * size);
+    }
+    return result;
+}
+
+/* Function: mymemalign
+--------------------------
+Given a power of two, alignment, and a number of bytes, requested_size, mymemalign returns a block of requested_size bytes that starts at a multiple of alignment.  Alignments of at most ALIGNMENT are met by every block, so those requests are passed to mymalloc.  Otherwise the block has room for requested_size bytes after the first aligned address past its header, which is at most alignment bytes in, and unless that address is right after the header, the word before it is set to the distance back to the header so myfree can find it.  mymemalign returns NULL if requested_size is 0, alignment is not a power of two, or there is not enough free memory.
+*/
+
+void *mymemalign(size_t alignment, size_t requested_size) {
+    if (requested_size == 0 || requested_size > MAX_REQUEST_SIZE || alignment > MAX_REQUEST_SIZE ||
+        (alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+    if (alignment <= ALIGNMENT) {
+        return mymalloc(requested_size);
+    }
+    void *location = alloc_order(order_for(requested_size + alignment - HEADER_SIZE));
+    if (location == NULL) {
+        return NULL;
+    }
+    char *payload = (char *)location + HEADER_SIZE;
+    char *aligned = (char *)(((uintptr_t)payload + alignment - 1) & ~(alignment - 1));
+    if (aligned != payload) {
+        ((header *)(aligned - HEADER_SIZE))->info = (size_t)(aligned - (char *)location) | ALIGNED_BIT;
+    }
+    return aligned;
+}
+
+/* Function: myfree
+-----------------------------
+Given a pointer to the heap, ptr, myfree will free the memory pointed to by the pointer so that it can be allocated again, merging it with its buddy at every order where the buddy is free.  myfree will do nothing if given a NULL pointer.
+
+This function assumes ptr points to the first address of a previously allocated block.
+*/
+
+void myfree(void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    void *location = get_location(ptr);
+    stats.frees++;
+    stats.allocated_bytes -= ((size_t)1 << get_order(location)) - HEADER_SIZE;
+    merge_free(location, get_order(location));
+}
+
+/* Function: myrealloc
+-----------------------------
+Given a pointer to the heap, old_ptr, and a size, new_size, myrealloc will return a pointer to new_size bytes holding the memory from old_ptr.  If the block gets smaller, its upper halves are split off and freed in place.  If it gets bigger, the block grows in place for as long as it is the lower buddy and its upper buddy is a free block of the same order.  Otherwise the memory is moved to a new block and old_ptr is freed.  If there is not enough space in the heap, myrealloc will not free old_ptr and returns NULL.  If old_ptr is NULL, myrealloc behaves like mymalloc, and if new_size is zero, it behaves like myfree.
+
+This function assumes that old_ptr points to the beggining of a previously allocated block of memory.
+*/
+
+void *myrealloc(void *old_ptr, size_t new_size) {
+    if (old_ptr == NULL) {
+        return mymalloc(new_size);
+    }
+    if (new_size == 0) {
+        myfree(old_ptr);
+        return NULL;
+    }
+    if (new_size > MAX_REQUEST_SIZE) {
+        return NULL;
+    }
+    void *location = get_location(old_ptr);
+    int order = get_order(location);
+    // a payload from mymemalign that starts further into its block is only kept in place if it fits as it is
+    if ((char *)old_ptr != (char *)location + HEADER_SIZE) {
+        size_t usable = (char *)location + ((size_t)1 << order) - (char *)old_ptr;
+        if (new_size <= usable) {
+            stats.reallocs++;
+            return old_ptr;
+        }
+        void *result = mymalloc(new_size);
+        if (result == NULL) {
+            return NULL;
+        }
+        memcpy(result, old_ptr, usable);
+        myfree(old_ptr);
+        stats.reallocs++;
+        return result;
+    }
+    int new_order = order_for(new_size);
+    // if the block shrinks, free the upper halves we no longer need
+    if (new_order <= order) {
+        stats.reallocs++;
+        stats.allocated_bytes -= ((size_t)1 << order) - ((size_t)1 << new_order);
+        while (order > new_order) {
+            order--;
+            merge_free((char *)location + ((size_t)1 << order), order);
+        }
+        make_used(location, order);
+        return old_ptr;
+    }
+    // check that every upper buddy up to new_order is free and whole before merging any of them
+    int cur_order = order;
+    while (cur_order < new_order) {
+        void *buddy = get_buddy(location, cur_order);
+        if (buddy == NULL || buddy < location || !is_free(buddy) || get_order(buddy) != cur_order) {
+            break;
+        }
+        cur_order++;
+    }
+    if (cur_order == new_order) {
+        for (cur_order = order; cur_order < new_order; cur_order++) {
+            remove_free(get_buddy(location, cur_order));
+        }
+        make_used(location, new_order);
+        stats.reallocs++;
+        stats.allocated_bytes += ((size_t)1 << new_order) - ((size_t)1 << order);
+        return old_ptr;
+    }
+    // not enough space for inplace realloc
+    void *result = mymalloc(new_size);
+    if (result == NULL) {
+        return NULL;
+    }
+    memcpy(result, old_ptr, ((size_t)1 << order) - HEADER_SIZE);  // copy the whole old payload
+    myfree(old_ptr);
+    stats.reallocs++;
+    return result;
+}
+
+/* Function: myfree_sized
+-----------------------------
+Given a pointer to the heap, ptr, and the size it was requested with, size, myfree_sized frees the block like myfree.  Every size from the requested size up to the usable size has the same order, so the order is found from size instead of from the header.
+*/
+
+void myfree_sized(void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return;
+    }
+    stats.frees++;
+    stats.allocated_bytes -= ((size_t)1 << order_for(size)) - HEADER_SIZE;
+    merge_free((char *)ptr - HEADER_SIZE, order_for(size));
+}
+
+/* Function: mymalloc_usable_size
+-----------------------------
+Given a pointer to an allocated block, ptr, mymalloc_usable_size returns the number of bytes the caller can use at ptr, which is the rest of the block of its order from ptr on.  It returns 0 if ptr is NULL.
+*/
+
+size_t mymalloc_usable_size(void *ptr) {
+    if (ptr == NULL) {
+        return 0;
+    }
+    void *location = get_location(ptr);
+    return (char *)location + ((size_t)1 << get_order(location)) - (char *)ptr;
+}
+
+/* Function: mymalloc_batch
+------------------------------------
+Given a number of bytes, size, a number of blocks, count, and an array, out, mymalloc_batch allocates count blocks of size bytes and stores pointers to them in out.  Every block of the buddy system is split off on its own, so each block is allocated with mymalloc.  It returns the number of blocks allocated, and the entries of out after the last one are set to NULL.
+*/
+
+size_t mymalloc_batch(size_t size, size_t count, void *out[]) {
+    size_t done = 0;
+    while (done < count && (out[done] = mymalloc(size)) != NULL) {
+        done++;
+    }
+    for (size_t i = done; i < count; i++) {
+        out[i] = NULL;
+    }
+    return done;
+}
+
+/* Function: myfree_batch
+------------------------------------
+Given an array of pointers to the heap, ptrs, and its length, count, myfree_batch frees every block in ptrs with myfree.  NULL entries are skipped.
+*/
+
+void myfree_batch(void *ptrs[], size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        myfree(ptrs[i]);
+    }
+}
+
+/* Function: allocator_stats
+---------------------------------
+allocator_stats returns a copy of stats.  Every block of an order has the same size, so the largest free block is a block of the highest order whose free list is not empty.  A free block is found without searching, so search_steps stays 0.
+*/
+
+allocator_stats_t allocator_stats() {
+    allocator_stats_t result = stats;
+    result.largest_free = (nonempty_orders == 0) ? 0 : ((size_t)1 << (63 - __builtin_clzl(nonempty_orders))) - HEADER_SIZE;
+    return result;
+}
+
+/* Function: validate_heap
+---------------------------------
+This function checks the internal structure of the heap by walking every block and ensuring that each one has a valid order, starts at a multiple of its size, and that together they cover the heap exactly.  No free block may have a free buddy of the same order, because the two should have been merged.  The free lists must contain exactly the free blocks of the heap, each on the list of its order with a prev pointer that matches the list.  If any check fails, validate_heap returns false, otherwise it returns true.
+*/
+
+bool validate_heap() {
+    size_t offset = 0;
+    size_t free_blocks = 0;
+    size_t free_bytes = 0;
+    // walk every block of the heap
+    while (offset < heap_used) {
+        void *location = (char *)segment_start + offset;
+        int order = get_order(location);
+        if (order < MIN_ORDER || order > MAX_ORDER || offset % ((size_t)1 << order) != 0) {
+            printf("Block at %p has bad order %d\n", location, order);
+            breakpoint();
+            return false;
+        }
+        if (is_free(location)) {
+            void *buddy = get_buddy(location, order);
+            if (buddy != NULL && is_free(buddy) && get_order(buddy) == order) {
+                printf("Free block at %p was not merged with its buddy\n", location);
+                breakpoint();
+                return false;
+            }
+            free_blocks++;
+            free_bytes += ((size_t)1 << order) - HEADER_SIZE;
+        }
+        offset += (size_t)1 << order;
+    }
+    if (offset != heap_used || heap_used > segment_size) {
+        printf("Blocks cover %zu bytes instead of %zu\n", offset, heap_used);
+        breakpoint();
+        return false;
+    }
+    if (free_blocks != stats.free_blocks || free_bytes != stats.free_bytes) {
+        printf("Stats count %zu free blocks of %zu bytes instead of %zu of %zu\n",
+               stats.free_blocks, stats.free_bytes, free_blocks, free_bytes);
+        breakpoint();
+        return false;
+    }
+    size_t listed_blocks = 0;
+    for (int order = 0; order <= MAX_ORDER; order++) {
+        if (((nonempty_orders >> order) & 1) != (free_lists[order] != NULL)) {
+            return false;
+        }
+        node *prev_node = NULL;
+        for (node *cur = free_lists[order]; cur != NULL; cur = cur->next) {
+            void *location = (char *)cur - HEADER_SIZE;
+            if (location < segment_start || (char *)location >= (char *)segment_start + heap_used ||
+                !is_free(location) || get_order(location) != order || cur->prev != prev_node) {
+                printf("Bad node %p on free list of order %d\n", cur, order);
+                breakpoint();
+                return false;
+            }
+            // stop early if the list has more nodes than free blocks exist
+            if (++listed_blocks > free_blocks) {
+                return false;
+            }
+            prev_node = cur;
+        }
+    }
+    return listed_blocks == free_blocks;
+}
+
+/* Function: dump_heap
+ * -------------------
+ * This function prints out the the block contents of the heap.  For every block, it prints the pointer to the header, a character indicating that it is free or used, the order of the block, and its size in hex.  dump_heap is not
+ * called anywhere, but is a useful helper function to call from gdb when
+ * tracing through programs.
+ */
+void dump_heap() {
+    printf("Heap segment starts at address %p, blocks end at %p\n", segment_start, (char *)segment_start + heap_used);
+    size_t offset = 0;
+    while (offset < heap_used) {
+        void *location = (char *)segment_start + offset;
+        int order = get_order(location);
+        printf("%p, %c, %d, %zx\n", location, is_free(location) ? 'f' : 'u', order, (size_t)1 << order);
+        offset += (size_t)1 << order;
+    }
+}
@@ -7,13 +7,20 @@
  * attention to robustness.
  *
  * This shows the very simplest of approaches; there are better options!
+ *
+ * Memory can still be reclaimed in bulk through the region interface in
+ * bump.h: releasing to a mark frees everything allocated after it, and
+ * arenas are child regions with their own marks.  mymalloc itself is
+ * unchanged by this and stays a single bounds check and an add.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "./allocator.h"
+#include "./bump.h"
 #include "./debug_break.h"
+#include "./segment.h"
 
 // how many bytes are printed per line in dump_heap
 #define BYTES_PER_LINE 32
@@ -21,17 +28,22 @@
 static void *segment_start;
 static size_t segment_size;
 static size_t nused;
+static size_t ntouched;  // bytes from the start of the heap that may have been written, the rest is still zero
+static size_t nmallocs, nfrees, nreallocs;  // calls counted for allocator_stats
 
 
 /* Function: myinit
  * ----------------
  * This function initializes our global variables based on the specified
- * segment boundary parameters.
+ * segment boundary parameters.  Only a segment fresh from segment.c is
+ * known to be all zero.
  */
 bool myinit(void *heap_start, size_t heap_size) {
     segment_start = heap_start;
     segment_size = heap_size;
     nused = 0;
+    nmallocs = nfrees = nreallocs = 0;
+    ntouched = heap_segment_fresh(heap_start) ? 0 : heap_size;
     return true;
 }
 
@@ -57,14 +69,116 @@ void *mymalloc(size_t requested_size) {
     }
     void *ptr = (char *)segment_start + nused;
     nused += needed;
+    nmallocs++;
+    return ptr;
+}
+
+/* Function: mycalloc
+ * ------------------
+ * This function places a block like mymalloc and clears it.  Bytes past
+ * the end of the heap have never been handed out, so in a fresh segment
+ * only the part of the block that was used before a bump_release has to be
+ * cleared.
+ */
+void *mycalloc(size_t nmemb, size_t size) {
+    if (nmemb == 0 || size == 0 || nmemb > MAX_REQUEST_SIZE / size) {
+        return NULL;
+    }
+    size_t offset = nused;
+    void *ptr = mymalloc(nmemb * size);
+    if (ptr != NULL && offset < ntouched) {
+        size_t dirty = ntouched - offset;
+        memset(ptr, 0, (dirty < nmemb * size) ? dirty : nmemb * size);
+    }
+    return ptr;
+}
+
+/* Function: mymemalign
+ * --------------------
+ * This function bumps the end of the heap up to the next multiple of
+ * alignment before placing the block there.  The skipped bytes are lost,
+ * like everything else that is freed.
+ */
+void *mymemalign(size_t alignment, size_t requested_size) {
+    if ((alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+    size_t gap = 0;
+    if (alignment > ALIGNMENT) {
+        gap = roundup((size_t)segment_start + nused, alignment) - ((size_t)segment_start + nused);
+    }
+    if (gap > segment_size - nused) {
+        return NULL;
+    }
+    nused += gap;
+    void *ptr = mymalloc(requested_size);
+    if (ptr == NULL) {
+        nused -= gap;
+    }
     return ptr;
 }
 
 /* Function: myfree
  * ----------------
- * This function does nothing - fast!... but lame :(
+ * This function does nothing - fast!... but lame :(  It only counts the
+ * call for allocator_stats.
+ */
+void myfree(void *ptr) {
+    if (ptr != NULL) {
+        nfrees++;
+    }
+}
+
+/* Function: myfree_sized
+ * ----------------------
+ * Like myfree, this function does nothing but count the call.
+ */
+void myfree_sized(void *ptr, size_t size) {
+    myfree(ptr);
+}
+
+/* Function: mymalloc_usable_size
+ * ------------------------------
+ * Blocks have no headers, so the size of a block is not recorded anywhere
+ * and this function returns 0.
+ */
+size_t mymalloc_usable_size(void *ptr) {
+    return 0;
+}
+
+/* Function: mymalloc_batch
+ * ------------------------
+ * This function places count blocks back to back at the end of the heap.
+ * One bounds check covers the whole run, after which each pointer is
+ * just an add.  If the heap can only hold some of the blocks, it places
+ * as many as fit and sets the rest of out to NULL.
  */
-void myfree(void *ptr) {}
+size_t mymalloc_batch(size_t size, size_t count, void *out[]) {
+    size_t needed = roundup(size, ALIGNMENT);
+    size_t fits = (needed == 0) ? count : (segment_size - nused) / needed;
+    size_t done = (fits < count) ? fits : count;
+    char *ptr = (char *)segment_start + nused;
+    for (size_t i = 0; i < done; i++) {
+        out[i] = ptr;
+        ptr += needed;
+    }
+    for (size_t i = done; i < count; i++) {
+        out[i] = NULL;
+    }
+    nused += done * needed;
+    nmallocs += done;
+    return done;
+}
+
+/* Function: myfree_batch
+ * ----------------------
+ * Like myfree, this function does nothing but count the blocks.
+ */
+void myfree_batch(void *ptrs[], size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        myfree(ptrs[i]);
+    }
+}
 
 /* Function: realloc
  * -----------------
@@ -73,12 +187,122 @@ void myfree(void *ptr) {}
  * existing contents to that region.  It's not particularly efficient.
  */
 void *myrealloc(void *old_ptr, size_t new_size) {
+    if (old_ptr != NULL) {
+        nreallocs++;
+    }
     void *new_ptr = mymalloc(new_size);
     memcpy(new_ptr, old_ptr, new_size);
     myfree(old_ptr);
     return new_ptr;
 }
 
+/* Function: bump_mark
+ * --------------------
+ * This function returns the number of heap bytes in use, which is where
+ * the next block will be placed.
+ */
+bump_mark_t bump_mark() {
+    return nused;
+}
+
+/* Function: bump_release
+ * ----------------------
+ * This function frees everything placed after mark by moving the end of
+ * the used part of the heap back to it.  A mark past the end is ignored.
+ * The freed bytes may have been written, so they no longer count as zero.
+ */
+void bump_release(bump_mark_t mark) {
+    if (mark <= nused) {
+        if (nused > ntouched) {
+            ntouched = nused;
+        }
+        nused = mark;
+    }
+}
+
+/* Function: bump_arena_alloc
+ * --------------------------
+ * This function places a block at the end of the used part of an arena,
+ * the same way mymalloc does for the heap.  The size is checked against the
+ * room left before it is rounded up, so a huge size can't wrap around.
+ */
+void *bump_arena_alloc(bump_arena *arena, size_t requested_size) {
+    if (requested_size > arena->size - arena->nused) {
+        return NULL;
+    }
+    size_t needed = roundup(requested_size, ALIGNMENT);
+    if (needed > arena->size - arena->nused) {
+        return NULL;
+    }
+    void *ptr = arena->start + arena->nused;
+    arena->nused += needed;
+    return ptr;
+}
+
+/* Function: bump_arena_new
+ * ------------------------
+ * This function allocates one block from the parent (or the heap) that
+ * holds the arena struct followed by the arena's own space, so the arena
+ * needs no bookkeeping outside its parent and goes away with it.  A size
+ * over MAX_REQUEST_SIZE is turned down before the struct is added to it, so
+ * the total can't wrap around.
+ */
+bump_arena *bump_arena_new(bump_arena *parent, size_t size) {
+    if (size > MAX_REQUEST_SIZE) {
+        return NULL;
+    }
+    size_t struct_size = roundup(sizeof(bump_arena), ALIGNMENT);
+    size = roundup(size, ALIGNMENT);
+    size_t total = struct_size + size;
+    bump_arena *arena = (parent == NULL) ? mymalloc(total) : bump_arena_alloc(parent, total);
+    if (arena == NULL) {
+        return NULL;
+    }
+    arena->start = (char *)arena + struct_size;
+    arena->size = size;
+    arena->nused = 0;
+    return arena;
+}
+
+/* Function: bump_arena_mark
+ * -------------------------
+ * This function returns the number of bytes in use in an arena.
+ */
+bump_mark_t bump_arena_mark(bump_arena *arena) {
+    return arena->nused;
+}
+
+/* Function: bump_arena_release
+ * ----------------------------
+ * This function frees everything placed in an arena after mark.  A mark
+ * past the end of the used part of the arena is ignored.
+ */
+void bump_arena_release(bump_arena *arena, bump_mark_t mark) {
+    if (mark <= arena->nused) {
+        arena->nused = mark;
+    }
+}
+
+/* Function: allocator_stats
+ * ---------------------------
+ * Nothing is ever freed, so every byte up to the end of the heap counts as
+ * allocated, including the bytes skipped for alignment and the arenas, and
+ * the rest of the segment is one free block.  There is never a search.
+ */
+allocator_stats_t allocator_stats() {
+    size_t free_bytes = segment_size - nused;
+    return (allocator_stats_t){
+        .allocated_bytes = nused,
+        .free_bytes = free_bytes,
+        .free_blocks = (free_bytes > 0) ? 1 : 0,
+        .largest_free = free_bytes,
+        .mallocs = nmallocs,
+        .frees = nfrees,
+        .reallocs = nreallocs,
+        .search_steps = 0,
+    };
+}
+
 /* Function: validate_heap
  * -----------------------
  * This function checks for potential errors/inconsistencies in the heap data
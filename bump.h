@@ -0,0 +1,66 @@
+/* File: bump.h
+ * ------------
+ * Region interface for the bump allocator.  A mark records how much of the
+ * heap is in use, and releasing back to a mark frees everything allocated
+ * after it at once.  An arena is a fixed-size child region carved out of the
+ * heap or out of another arena, with its own marks, so a request handler can
+ * allocate from its own arena and throw all of it away in O(1).
+ *
+ * These functions are only provided by bump.c.
+ */
+
+#ifndef _BUMP_H
+#define _BUMP_H
+
+#include <stddef.h>  // for size_t
+
+// A checkpoint in the heap or in an arena: the number of bytes in use when it was taken
+typedef size_t bump_mark_t;
+
+// A child region that allocations can be bumped from
+typedef struct bump_arena {
+    char *start;   // first byte that arena allocations can use
+    size_t size;   // number of bytes that arena allocations can use
+    size_t nused;  // number of bytes in use
+} bump_arena;
+
+
+/* Functions: bump_mark, bump_release
+ * ----------------------------------
+ * bump_mark returns a mark for the current end of the heap.  bump_release
+ * frees every block that mymalloc returned after the mark was taken, as well
+ * as every arena created from the heap after it, so the next mymalloc starts
+ * at the mark again.  Releasing to a mark that is past the current end of the
+ * heap does nothing.
+ */
+bump_mark_t bump_mark();
+void bump_release(bump_mark_t mark);
+
+
+/* Function: bump_arena_new
+ * ------------------------
+ * Carves an arena with room for size bytes out of parent, or out of the heap
+ * if parent is NULL, and returns it.  The arena is freed along with the rest
+ * of its parent when the parent is released to a mark taken before it was
+ * created.  Returns NULL if the parent does not have room.
+ */
+bump_arena *bump_arena_new(bump_arena *parent, size_t size);
+
+
+/* Function: bump_arena_alloc
+ * --------------------------
+ * Allocates requested_size bytes from arena, or returns NULL if the arena is
+ * out of room.
+ */
+void *bump_arena_alloc(bump_arena *arena, size_t requested_size);
+
+
+/* Functions: bump_arena_mark, bump_arena_release
+ * ----------------------------------------------
+ * The same as bump_mark and bump_release, for the blocks and child arenas of
+ * one arena.  Releasing to a mark of 0 empties the arena.
+ */
+bump_mark_t bump_arena_mark(bump_arena *arena);
+void bump_arena_release(bump_arena *arena, bump_mark_t mark);
+
+#endif
@@ -0,0 +1,160 @@
+/* File: bump_test.c
+ * -----------------
+ * A program that checks the region interface of the bump allocator in
+ * bump.h: marks and releases on the heap, arenas nested in other arenas,
+ * releasing a parent past the point where a child arena was created, and
+ * mycalloc clearing memory that was used before a bump_release.
+ *
+ * Usage: ./bump_test
+ * Exits with status 1 and a message for the first check that fails.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "allocator.h"
+#include "bump.h"
+#include "segment.h"
+
+#define HEAP_SIZE (1L << 24)
+
+// number of checks that passed, printed at the end
+static int nchecked = 0;
+
+
+/* Function: check
+ * ---------------
+ * Exits with the message what if ok is false, and counts the check
+ * otherwise.
+ */
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        fprintf(stderr, "bump_test: %s\n", what);
+        exit(1);
+    }
+    nchecked++;
+}
+
+/* Function: is_zero
+ * -----------------
+ * Returns whether the first size bytes at ptr are all zero.
+ */
+static bool is_zero(const unsigned char *ptr, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (ptr[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Function: check_heap_marks
+ * --------------------------
+ * Checks that releasing the heap to a mark makes mymalloc start at the mark
+ * again, that an arena created from the heap after the mark goes away with
+ * it, and that a mark past the end of the heap is ignored.
+ */
+static void check_heap_marks() {
+    char *first = mymalloc(100);
+    bump_mark_t mark = bump_mark();
+    char *second = mymalloc(200);
+    bump_arena *arena = bump_arena_new(NULL, 1000);
+    check(first != NULL && second != NULL && arena != NULL, "mymalloc or bump_arena_new failed on an empty heap");
+    check(second > first && (char *)arena > second, "heap blocks are not placed one after another");
+    bump_release(mark);
+    check(mymalloc(200) == second, "mymalloc after bump_release does not start at the mark");
+    check(bump_arena_new(NULL, 1000) == arena, "an arena created after the mark was not released with the heap");
+    bump_mark_t end = bump_mark();
+    bump_release(end + 64);
+    check(bump_mark() == end, "bump_release to a mark past the end of the heap moved the end");
+}
+
+/* Function: check_nested_arenas
+ * -----------------------------
+ * Checks arenas carved out of other arenas: a child's blocks lie inside its
+ * parent, releasing a child leaves its parent alone, releasing the parent to
+ * a mark taken before the child was created hands the child's space out
+ * again, and a full arena turns requests down.
+ */
+static void check_nested_arenas() {
+    bump_arena *parent = bump_arena_new(NULL, 4096);
+    check(parent != NULL, "bump_arena_new failed for a parent arena");
+    char *before = bump_arena_alloc(parent, 64);
+    bump_mark_t parent_mark = bump_arena_mark(parent);
+    bump_arena *child = bump_arena_new(parent, 1024);
+    check(child != NULL, "bump_arena_new failed for a child arena");
+    bump_arena *grandchild = bump_arena_new(child, 256);
+    check(grandchild != NULL, "bump_arena_new failed for an arena inside a child arena");
+
+    char *in_child = bump_arena_alloc(child, 100);
+    char *in_grandchild = bump_arena_alloc(grandchild, 100);
+    check(in_child >= parent->start && in_child + 100 <= parent->start + parent->size,
+        "a block of a child arena is outside its parent");
+    check(in_grandchild >= child->start && in_grandchild + 100 <= child->start + child->size,
+        "a block of a grandchild arena is outside its parent");
+    check((uintptr_t)in_child % ALIGNMENT == 0 && (uintptr_t)in_grandchild % ALIGNMENT == 0,
+        "an arena block is not aligned");
+    memset(in_child, 1, 100);
+    memset(in_grandchild, 2, 100);
+
+    // releasing the child empties it, but the parent still holds the child
+    bump_mark_t parent_used = bump_arena_mark(parent);
+    bump_arena_release(child, 0);
+    check(bump_arena_mark(child) == 0, "releasing a child arena to 0 did not empty it");
+    check(bump_arena_mark(parent) == parent_used, "releasing a child arena changed its parent");
+    check(bump_arena_alloc(child, 16) == child->start, "a released child arena does not start over");
+
+    // releasing the parent past the child's creation frees the child and grandchild with it
+    bump_arena_release(parent, parent_mark);
+    check(bump_arena_mark(parent) == parent_mark, "releasing a parent arena did not move its end to the mark");
+    check(bump_arena_alloc(parent, 16) == (char *)child, "the space of a released child arena was not reused");
+    check(before == parent->start, "the first block of an arena is not at its start");
+
+    // an arena only hands out its own room, and sizes that would wrap around are turned down
+    check(bump_arena_alloc(parent, 4096) == NULL, "an arena handed out more room than it has");
+    check(bump_arena_alloc(parent, SIZE_MAX) == NULL, "bump_arena_alloc did not turn down SIZE_MAX bytes");
+    check(bump_arena_new(parent, 8192) == NULL, "a child arena bigger than its parent was created");
+    check(bump_arena_new(NULL, SIZE_MAX) == NULL, "bump_arena_new did not turn down SIZE_MAX bytes");
+    check(bump_arena_new(parent, SIZE_MAX - 4) == NULL, "bump_arena_new did not turn down a size that wraps around");
+}
+
+/* Function: check_calloc_after_release
+ * ------------------------------------
+ * Checks that mycalloc clears memory that was written and then freed by
+ * bump_release, both when the new block lies wholly in the released part
+ * and when it runs past it into memory that was never used, and that this
+ * holds for memory an arena wrote.
+ */
+static void check_calloc_after_release() {
+    bump_mark_t mark = bump_mark();
+    unsigned char *dirty = mymalloc(500);
+    memset(dirty, 0xff, 500);
+    bump_release(mark);
+    unsigned char *inside = mycalloc(10, 30);
+    check(inside == dirty, "mycalloc after bump_release does not start at the mark");
+    check(is_zero(inside, 300), "mycalloc returned memory written before bump_release without clearing it");
+    bump_release(mark);
+    unsigned char *across = mycalloc(1, 2000);
+    check(is_zero(across, 2000), "mycalloc that runs past released memory did not clear it");
+
+    bump_release(mark);
+    bump_arena *arena = bump_arena_new(NULL, 1000);
+    memset(bump_arena_alloc(arena, 1000), 0xee, 1000);
+    bump_release(mark);
+    unsigned char *over_arena = mycalloc(1, 1100);
+    check(is_zero(over_arena, 1100), "mycalloc returned memory written by a released arena without clearing it");
+}
+
+int main(int argc, char *argv[]) {
+    reserve_heap_segment(HEAP_SIZE);
+    if (!myinit(heap_segment_start(), heap_segment_size())) {
+        fprintf(stderr, "bump_test: myinit() returned false\n");
+        return 1;
+    }
+    check_heap_marks();
+    check_nested_arenas();
+    check_calloc_after_release();
+    printf("bump_test: %d checks passed\n", nchecked);
+    return 0;
+}
@@ -2,31 +2,142 @@
 Code written by: Christo Hristov
 
 This file contains a series of utility functions implemented to allocate, free, and reallocate memory from a heap.  These functions are used in the test_explicit.c file.
+
+Free blocks are kept in an array of segregated free lists (buckets).  Small sizes each get their own exact-size bucket, and larger sizes share power-of-two buckets, so mymalloc can start searching at the right bucket instead of walking every free block in the heap.  Free blocks of at least TREE_MIN_SIZE bytes are kept in a red-black tree ordered by size and then address instead, stored in their payloads like the list nodes, so large requests get the best fit in O(log n) time.
+
+Every free block also ends in a footer holding its size, and every header has a bit recording whether the block before it is free.  This lets myfree find both neighbours of a block in constant time, so adjacent free blocks are always merged and the heap never holds two free blocks in a row.
+
+Requests of at most MAX_SLAB_OBJECT bytes are served from slabs.  A slab is a page-aligned used block that is carved into objects of one size, with a bitmap of free objects at its start and no header on each object.  A bitmap of pages, slab_pages, records which pages hold a slab, so myfree can tell from the address alone whether a pointer is a slab object.  A size only gets a slab once small_live counts enough live objects of that size to fill one, and until then its requests get ordinary heap blocks, so a program with a few small blocks of each size does not pin a page, and the gap before it, for every size.
+
+When no free block is big enough, the heap grows by mapping another chunk with extend_heap_segment instead of failing.  Each added chunk is at least as big as the whole heap so far, and ends in an epilogue, a header of a used block with no payload, so no block ever merges across the end of a chunk.  The first chunk is the memory given to myinit and has no epilogue.
+
+Requests of at least MMAP_THRESHOLD bytes do not use the heap at all.  Each gets a region, a mapping of its own from map_heap_region, with a header marked by MAPPED_BIT, so freeing it unmaps it right away instead of leaving a giant hole in the heap, and resizing it uses mremap, which moves its pages instead of copying them.
+
+When a free block of at least RELEASE_MIN_SIZE bytes is made by myfree, the whole pages inside it are handed back to the kernel with madvise, so the memory of a long-lived process goes back down after a peak.  The pages are faulted back in, zeroed, when the block is used again.
+
+Each free block in the tree records whether its payload is zero apart from its tree node and footer.  This is true of a fresh segment given to myinit, of every chunk added by grow_heap, of a block whose pages were released (the few bytes around the released pages are cleared along with them), and of what is left after a block is split off the front of one of these.  mycalloc only clears the bytes of such a block that are not known to be zero, so a large zeroed allocation costs about as much as mymalloc.  This relies on the heap being anonymous memory, which reads back as zero after it is released with madvise.
+
+When compiled with THREAD_SAFE defined, the heap is protected by a lock, and each thread keeps a cache of small blocks for every slab class and exact-size bucket.  The caches refill from and drain to the shared heap in batches, so most small requests take no lock.
 */
 
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include "./allocator.h"
 #include "./debug_break.h"
+#include "./segment.h"
 
-#define BLOCK_SIZE 8  // define a constant to hold the number of bytes in a block
-#define MIN_BLOCK 24  // define a constant to hold the min number of bytes that can be allocated
+#define BLOCK_SIZE ALIGNMENT  // define a constant to hold the number of bytes in a header, a whole ALIGNMENT so payloads stay aligned
+#define MIN_BLOCK (16 + BLOCK_SIZE)  // define a constant to hold the min number of bytes that can be allocated, a list node and a footer
+#define USED_BIT 1  // bit of the header that is set when the block is used
+#define PREV_FREE_BIT 2  // bit of the header that is set when the block before it in the heap is free
+#define MAPPED_BIT 4  // bit of the header that is set when the block has a mapping of its own
+#define SIZE_MASK (~(size_t)(ALIGNMENT - 1))  // mask that clears the status bits of a header
+#define MAX_EXACT_SIZE 256  // largest size that has its own exact-size bucket
+#define NUM_EXACT_BUCKETS ((MAX_EXACT_SIZE - MIN_BLOCK) / ALIGNMENT + 1)  // buckets for sizes MIN_BLOCK..MAX_EXACT_SIZE
+#define EXACT_SIZE_LOG 8  // log2 of MAX_EXACT_SIZE, the first power-of-two bucket holds sizes above this
+#define TREE_MIN_LOG 10  // log2 of TREE_MIN_SIZE
+#define TREE_MIN_SIZE (1 << TREE_MIN_LOG)  // free blocks of at least this size go in the tree instead of a bucket
+#define NUM_BUCKETS (NUM_EXACT_BUCKETS + TREE_MIN_LOG - EXACT_SIZE_LOG)  // number of segregated free lists
+#define SLAB_SIZE 4096  // bytes in a slab, each slab starts on a page boundary
+#define SLAB_SHIFT 12  // log2 of SLAB_SIZE
+#define MAX_SLAB_OBJECT 64  // largest request that is served from a slab
+#define NUM_SLAB_CLASSES (MAX_SLAB_OBJECT / ALIGNMENT)  // one slab class for each object size 8, 16, ..., MAX_SLAB_OBJECT
+#define SLAB_BITMAP_WORDS 8  // words of free bits in a slab, enough for the objects of the smallest class
+#define SLAB_HEADER ((sizeof(slab) + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1))  // bytes before the first object of a slab
+#define SLAB_MAP_PAGES (1UL << 23)  // number of pages from the start of the heap that can hold a slab (32 GiB)
+#define MMAP_THRESHOLD (1 << 24)  // requests of at least this size get a mapping of their own
+#define RELEASE_MIN_SIZE (128 * 1024)  // free blocks made by myfree of at least this size give their pages back to the kernel
 
 static void *segment_start;
 static size_t segment_size;
-static void *first_free;
+static size_t num_mapped;  // number of blocks with a mapping of their own
+static void *buckets[NUM_BUCKETS];  // first node of each segregated free list, or NULL if the list is empty
+static unsigned long nonempty_buckets;  // bit i is set if buckets[i] contains at least one free block
+static allocator_stats_t stats;  // counters returned by allocator_stats, only changed with the heap lock held
+
+#ifdef THREAD_SAFE
+#include <pthread.h>
+
+#define CACHE_CAPACITY 64  // most blocks of one size class a thread keeps before draining some to the heap
+#define CACHE_BATCH 32  // number of blocks moved between a thread cache and the heap under one lock
+
+// a cached block is still marked used in the heap, and its payload links it to the next cached block
+typedef struct cached_block {
+    struct cached_block *next;
+} cached_block;
+
+// the first NUM_SLAB_CLASSES cache classes hold slab objects, the rest hold blocks of an exact-size bucket
+#define NUM_CACHE_CLASSES (NUM_SLAB_CLASSES + NUM_EXACT_BUCKETS)
+
+// each thread keeps a list of small free blocks for every cache class
+typedef struct {
+    cached_block *heads[NUM_CACHE_CLASSES];
+    int counts[NUM_CACHE_CLASSES];
+    unsigned long generation;  // heap_generation when the cache was filled
+    allocator_stats_t pending;  // counts of calls served by the cache, added to stats the next time the lock is taken
+} cache;
+
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;  // protects the heap and the buckets
+static unsigned long heap_generation;  // incremented by myinit so threads drop blocks cached from an old heap
+static __thread cache thread_cache;
+static pthread_key_t cache_key;  // drains a thread's cache when the thread exits
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+static pthread_once_t fork_once = PTHREAD_ONCE_INIT;  // registers the fork handlers of the heap lock
+
+#define LOCK_HEAP() pthread_mutex_lock(&heap_lock)
+#define UNLOCK_HEAP() pthread_mutex_unlock(&heap_lock)
+#else
+#define LOCK_HEAP()
+#define UNLOCK_HEAP()
+#endif
 
 // create a struct, header, to hold the size of the block of memory indicated by the header
 typedef struct {
     size_t size;  // number ending in one if the ehader is used and zero if the header is free
 } header;
 
+// a free block stores its payload size in a footer in the last bytes of its payload
+typedef struct {
+    size_t size;
+} footer;
+
 // create a struct to hold a node in the free linked list
 typedef struct {
     void *next;  // pointer to next node in list
     void *prev;  // pointer to previous node in list
 } node;
 
+// a free block of at least TREE_MIN_SIZE bytes holds a node of the red-black tree instead of a list node
+typedef struct tree_node {
+    struct tree_node *left;  // subtree of blocks that are smaller, or the same size at a lower address
+    struct tree_node *right;  // subtree of blocks that are bigger, or the same size at a higher address
+    struct tree_node *parent;
+    bool red;
+    bool zeroed;  // true if the payload of the block is all zero except for this node and the footer
+} tree_node;
+
+static tree_node *tree_root;  // root of the tree of large free blocks, or NULL if there are none
+
+// a slab sits at the start of a page-aligned used block and is followed by its objects
+typedef struct slab {
+    struct slab *next;  // next slab of the same class that has a free object
+    struct slab *prev;  // previous slab of the same class that has a free object
+    unsigned short object_size;  // bytes in each object of the slab
+    unsigned short nobjects;  // number of objects that fit in the slab
+    unsigned short nfree;  // number of objects that are free
+    unsigned long free_map[SLAB_BITMAP_WORDS];  // bit i is set if object i is free
+} slab;
+
+static slab *partial_slabs[NUM_SLAB_CLASSES];  // slabs of each class that have at least one free object
+static unsigned long slab_pages[SLAB_MAP_PAGES / 64];  // bit i is set if page i from the start of the heap holds a slab
+static size_t slab_pages_used;  // number of words at the start of slab_pages that may have bits set
+static size_t num_slabs;  // number of slabs in the heap
+static size_t small_live[NUM_SLAB_CLASSES];  // used heap blocks and slab objects of each slab class size, see count_small
+
 /* Function: roundup
 ----------------------------
 Given an amount, sz, and a mulitplier, mult, roudnup returns the smallest number that is a multiple of mult and is larger or equal to sz.
@@ -44,92 +155,382 @@ This function assumes that headerptr points to a header in the heap memory paylo
 bool is_free(void *headerptr) {
     header *header_ptr = (header *)headerptr;
     // checign if least significant digit is 0 or 1
-    if ((header_ptr->size & 1) == 0) {
+    if ((header_ptr->size & USED_BIT) == 0) {
         return true;
     } else {
         return false;
     }
 }
 
-/* Function: make_free
-----------------------------------
-Given a pointer to where we want a free block, location, a size of the free block, space, a pointer to the next node in the free linked list, next_block, and a pointer to the previous node in the free linked list, prev_block, make_free will make a free block in the heap payload at location with the indicated size and update the free linked list to include this new block.
+/* Function: get_size
+-------------------------------
+Given a void pointer, headerptr, get_size returns the number of payload bytes in the block indicated by the header, ignoring the status bits stored in the low bits of the header.
 
-This function assumes that locatio is a memory address in the heap payload, that space is alligned, and that next_block and prev_block point to nodes in the free linked list or are NULL.
+This function assumes that headerptr points to a header in the heap memory payload.
 */
 
-void make_free(void *location, size_t space, void *next_block, void *prev_block) {
-    header *new_header = (header *)location;  // make a block header for the free block
-    new_header->size = space;  // make the block header contain the indicated size
-    node *new_node = (node *)((char *)location + BLOCK_SIZE);  // create a new node for the free block
-    // update the pointers of the node
-    new_node->next = next_block;
-    new_node->prev = prev_block;
-    // if there is a previous block
-    if (prev_block != NULL) {
-        node *past_node = (node *)prev_block;  
-        past_node->next = new_node;  // make previous block point to the new free block
-        // if there is no previous block (the new block is the first free block)
+size_t get_size(void *headerptr) {
+    return ((header *)headerptr)->size & SIZE_MASK;
+}
+
+/* Function: prev_is_free
+-------------------------------
+Given a void pointer, headerptr, prev_is_free returns true if the header records that the block right before it in the heap is free, and false otherwise.
+
+This function assumes that headerptr points to a header in the heap memory payload.
+*/
+
+bool prev_is_free(void *headerptr) {
+    return (((header *)headerptr)->size & PREV_FREE_BIT) != 0;
+}
+
+/* Function: set_prev_free
+-------------------------------
+Given a pointer to the end of a block, next_location, and whether that block is free, prev_free, set_prev_free updates the header of the block that starts at next_location to record the status of the block before it.  Nothing is updated if next_location is the end of the first chunk.  The other chunks end in an epilogue header, which is updated like any other.
+*/
+
+void set_prev_free(void *next_location, bool prev_free) {
+    if (next_location == (void *)((char *)segment_start + segment_size)) {
+        return;
+    }
+    header *next_header = (header *)next_location;
+    if (prev_free) {
+        next_header->size |= PREV_FREE_BIT;
     } else {
-        first_free = location;  // update first_free global pointer
+        next_header->size &= ~(size_t)PREV_FREE_BIT;
     }
-    // if there is a next block in the linked list
-    if (next_block != NULL) {
-        node *next_node = (node *)next_block;
-        next_node->prev = new_node;  // make previous pointer of next block point to new free block
+}
+
+/* Function: get_bucket
+-------------------------------
+Given the payload size of a free block, space, get_bucket returns the index of the segregated free list that the block belongs in.  Sizes up to MAX_EXACT_SIZE each have their own bucket, so every block in one of those buckets is the same size.  Larger sizes are grouped by power of two, so bucket NUM_EXACT_BUCKETS holds sizes in (256, 512), and the next holds [512, 1024).
+
+This function assumes that space is alligned, at least MIN_BLOCK, and less than TREE_MIN_SIZE.
+*/
+
+int get_bucket(size_t space) {
+    if (space <= MAX_EXACT_SIZE) {
+        return (space - MIN_BLOCK) / ALIGNMENT;
     }
+    int log = 63 - __builtin_clzl(space);  // index of the highest set bit of space
+    return NUM_EXACT_BUCKETS + log - EXACT_SIZE_LOG;
 }
 
-/* Function: coalesce
---------------------------------
-Given a pointer to a free block, location,  coalesce will coalesce the inputted free block with any free blocks following the indicated block and touching.
+/* Function: slab_class
+------------------------------
+Given a number of bytes that is at most MAX_SLAB_OBJECT, requested_size, slab_class returns the index of the slab class whose objects hold it.
+*/
+
+int slab_class(size_t requested_size) {
+    return roundup(requested_size, ALIGNMENT) / ALIGNMENT - 1;
+}
+
+/* Function: count_small
+------------------------------
+Given the payload size of a heap block or slab object that was just handed out or is about to be freed, size, and 1 or -1, delta, count_small adds delta to the entry of small_live for its size if it is at most MAX_SLAB_OBJECT.  Sizes below MIN_BLOCK are counted as MIN_BLOCK, the smallest heap block, so a request is counted in the same entry whether it gets a heap block or a slab object.  Blocks held in thread caches are still used in the heap, so they are counted.  In a THREAD_SAFE build, the caller must hold the heap lock.
+*/
+
+void count_small(size_t size, int delta) {
+    if (size <= MAX_SLAB_OBJECT) {
+        small_live[slab_class((size < MIN_BLOCK) ? MIN_BLOCK : size)] += delta;
+    }
+}
+
+/* Functions: get_chunk_start, get_chunk_size
+-------------------------------
+Given the number of a chunk of the heap, chunk, get_chunk_start returns its start and get_chunk_size its size in bytes, including the epilogue that ends every chunk but the first.  Chunk 0 is the memory given to myinit, which may be only part of the segment.  The chunks after it are the ones grow_heap added with extend_heap_segment, which segment.c keeps track of, and there are heap_segment_chunks() chunks in all.
+*/
+
+void *get_chunk_start(int chunk) {
+    return (chunk == 0) ? segment_start : heap_chunk_start(chunk);
+}
+
+size_t get_chunk_size(int chunk) {
+    return (chunk == 0) ? segment_size : heap_chunk_size(chunk);
+}
+
+/* Function: tree_size
+-------------------------------
+Given a tree node, cur, tree_size returns the payload size of the free block holding it.
+*/
+
+size_t tree_size(tree_node *cur) {
+    return get_size((char *)cur - BLOCK_SIZE);
+}
+
+/* Function: tree_less
+-------------------------------
+Given two tree nodes, a and b, tree_less returns true if a comes before b in the tree, which orders blocks by size and blocks of the same size by address.
+*/
+
+bool tree_less(tree_node *a, tree_node *b) {
+    size_t a_size = tree_size(a);
+    size_t b_size = tree_size(b);
+    return a_size < b_size || (a_size == b_size && a < b);
+}
+
+/* Function: tree_rotate
+-------------------------------
+Given a tree node, x, and whether to rotate left, left, tree_rotate moves the right child of x (for a left rotation) or the left child of x (for a right rotation) up into the place of x, and makes x its child.
+
+This function assumes that x has the child that moves up.
+*/
+
+void tree_rotate(tree_node *x, bool left) {
+    tree_node *y = left ? x->right : x->left;
+    // the inner subtree of y moves across to x
+    tree_node *inner = left ? y->left : y->right;
+    if (left) {
+        x->right = inner;
+    } else {
+        x->left = inner;
+    }
+    if (inner != NULL) {
+        inner->parent = x;
+    }
+    // y takes the place of x under its parent
+    y->parent = x->parent;
+    if (x->parent == NULL) {
+        tree_root = y;
+    } else if (x == x->parent->left) {
+        x->parent->left = y;
+    } else {
+        x->parent->right = y;
+    }
+    if (left) {
+        y->left = x;
+    } else {
+        y->right = x;
+    }
+    x->parent = y;
+}
+
+/* Function: tree_insert
+-------------------------------
+Given a tree node of a free block, cur, tree_insert adds it to the tree and recolors and rotates the tree to keep it balanced.
+*/
+
+void tree_insert(tree_node *cur) {
+    tree_node *parent = NULL;
+    tree_node *temp = tree_root;
+    // walk down to the empty spot where cur belongs
+    while (temp != NULL) {
+        parent = temp;
+        temp = tree_less(cur, temp) ? temp->left : temp->right;
+    }
+    cur->parent = parent;
+    cur->left = NULL;
+    cur->right = NULL;
+    cur->red = true;
+    if (parent == NULL) {
+        tree_root = cur;
+    } else if (tree_less(cur, parent)) {
+        parent->left = cur;
+    } else {
+        parent->right = cur;
+    }
+    // while cur and its parent are both red, fix the tree above cur
+    while (cur->parent != NULL && cur->parent->red) {
+        tree_node *grandparent = cur->parent->parent;  // a red node is never the root, so this exists
+        bool parent_is_left = (cur->parent == grandparent->left);
+        tree_node *uncle = parent_is_left ? grandparent->right : grandparent->left;
+        // if the uncle is red, push the red up to the grandparent
+        if (uncle != NULL && uncle->red) {
+            cur->parent->red = false;
+            uncle->red = false;
+            grandparent->red = true;
+            cur = grandparent;
+        } else {
+            // if cur is an inner child, rotate it to the outside first
+            if (cur == (parent_is_left ? cur->parent->right : cur->parent->left)) {
+                cur = cur->parent;
+                tree_rotate(cur, parent_is_left);
+            }
+            cur->parent->red = false;
+            grandparent->red = true;
+            tree_rotate(grandparent, !parent_is_left);
+        }
+    }
+    tree_root->red = false;
+}
+
+/* Function: tree_replace
+-------------------------------
+Given a tree node, old, and a tree node or NULL, replacement, tree_replace puts replacement in the place of old under the parent of old.
+*/
+
+void tree_replace(tree_node *old, tree_node *replacement) {
+    if (old->parent == NULL) {
+        tree_root = replacement;
+    } else if (old == old->parent->left) {
+        old->parent->left = replacement;
+    } else {
+        old->parent->right = replacement;
+    }
+    if (replacement != NULL) {
+        replacement->parent = old->parent;
+    }
+}
+
+/* Function: tree_remove
+-------------------------------
+Given a tree node in the tree, cur, tree_remove removes it from the tree and recolors and rotates the tree to keep it balanced.
+*/
+
+void tree_remove(tree_node *cur) {
+    tree_node *moved = cur;  // the node that is taken out of its place in the tree
+    bool moved_red = moved->red;
+    tree_node *child;  // the node that takes the old place of moved, or NULL
+    tree_node *parent;  // the parent of that place
+    if (cur->left == NULL || cur->right == NULL) {
+        child = (cur->left != NULL) ? cur->left : cur->right;
+        parent = cur->parent;
+        tree_replace(cur, child);
+    } else {
+        // with two children, cur is replaced by the smallest node of its right subtree
+        moved = cur->right;
+        while (moved->left != NULL) {
+            moved = moved->left;
+        }
+        moved_red = moved->red;
+        child = moved->right;
+        if (moved->parent == cur) {
+            parent = moved;
+        } else {
+            parent = moved->parent;
+            tree_replace(moved, moved->right);
+            moved->right = cur->right;
+            moved->right->parent = moved;
+        }
+        tree_replace(cur, moved);
+        moved->left = cur->left;
+        moved->left->parent = moved;
+        moved->red = cur->red;
+    }
+    // removing a black node leaves the path through child one black node short
+    if (moved_red) {
+        return;
+    }
+    while (child != tree_root && (child == NULL || !child->red)) {
+        bool child_is_left = (child == parent->left);
+        tree_node *sibling = child_is_left ? parent->right : parent->left;
+        // if the sibling is red, rotate so that the sibling is black
+        if (sibling->red) {
+            sibling->red = false;
+            parent->red = true;
+            tree_rotate(parent, child_is_left);
+            sibling = child_is_left ? parent->right : parent->left;
+        }
+        tree_node *near = child_is_left ? sibling->left : sibling->right;
+        tree_node *far = child_is_left ? sibling->right : sibling->left;
+        // if both children of the sibling are black, the sibling can turn red and the problem moves up
+        if ((near == NULL || !near->red) && (far == NULL || !far->red)) {
+            sibling->red = true;
+            child = parent;
+            parent = child->parent;
+        } else {
+            // make sure the far child of the sibling is red
+            if (far == NULL || !far->red) {
+                near->red = false;
+                sibling->red = true;
+                tree_rotate(sibling, !child_is_left);
+                sibling = child_is_left ? parent->right : parent->left;
+                far = child_is_left ? sibling->right : sibling->left;
+            }
+            sibling->red = parent->red;
+            parent->red = false;
+            far->red = false;
+            tree_rotate(parent, child_is_left);
+            child = tree_root;
+        }
+    }
+    if (child != NULL) {
+        child->red = false;
+    }
+}
+
+/* Function: tree_best_fit
+-------------------------------
+Given an alligned number of bytes, needed, tree_best_fit returns the node of the smallest free block in the tree with at least needed bytes, choosing the lowest address among blocks of that size, or NULL if no block in the tree is big enough.
+*/
+
+tree_node *tree_best_fit(size_t needed) {
+    tree_node *best = NULL;
+    tree_node *temp = tree_root;
+    while (temp != NULL) {
+        stats.search_steps++;
+        // a block that fits is the best so far, and a better one can only be to its left
+        if (tree_size(temp) >= needed) {
+            best = temp;
+            temp = temp->left;
+        } else {
+            temp = temp->right;
+        }
+    }
+    return best;
+}
+
+/* Function: make_free
+----------------------------------
+Given a pointer to where we want a free block, location, and a size of the free block, space, make_free will make a free block in the heap payload at location with the indicated size and push it onto the front of the free list of its bucket, or add it to the tree, not marked zeroed, if it is at least TREE_MIN_SIZE bytes.  The block is added to the free block counts of stats.  It writes the footer of the block and marks the following block as having a free block before it.
 
-This function assumes that location points to the header of a free block.
+This function assumes that locatio is a memory address in the heap payload, that space is alligned and at least MIN_BLOCK, that the block is not already on a free list, and that the block before it is not free.
 */
 
-void coalesce(void *location) {
-    void *end_heap = (char *)segment_start + segment_size;
-    header *cur_header = (header *)location;
-    size_t cur_space = cur_header->size;
-    size_t count = cur_space;  // create a variable count to keep track of total free space
-    node *cur_node = (node *)((char *)location + BLOCK_SIZE);
-    //  after we coalesce, the previous of the new block will equal the previous of the first coalesced block,
-    // and the next of the new block will equal the next of the last coalesced block
-    void *prev_block = cur_node->prev;  // store previous of first coalesced block
-    void *next_block = cur_node->next;  // store next of first coalesced block in case no blocks to be coalesced
-    void *temp = (char *)location + count + BLOCK_SIZE;  // create a pointer to traverse heap
-    // while consecutive free blocks are remianing
-    while ((temp < end_heap) && is_free(temp)) {
-        size_t new_space = ((header *)temp)->size + BLOCK_SIZE;
-        count += new_space;  // update total space of coalesced blocks
-        node *new_node = (node *)((char *)temp + BLOCK_SIZE);
-        next_block = new_node->next;  // update next to point to next of last coalesced block
-        temp = (char *)temp + new_space;  // update temp to point to next header
+void make_free(void *location, size_t space) {
+    header *new_header = (header *)location;  // make a block header for the free block
+    new_header->size = space;  // make the block header contain the indicated size
+    footer *new_footer = (footer *)((char *)location + space);  // the footer is the last BLOCK_SIZE bytes of the payload
+    new_footer->size = space;
+    set_prev_free((char *)location + BLOCK_SIZE + space, true);
+    stats.free_blocks++;
+    stats.free_bytes += space;
+    if (space >= TREE_MIN_SIZE) {
+        tree_node *cur = (tree_node *)((char *)location + BLOCK_SIZE);
+        cur->zeroed = false;  // callers that know better mark the block zeroed afterwards
+        tree_insert(cur);
+        return;
+    }
+    node *new_node = (node *)((char *)location + BLOCK_SIZE);  // create a new node for the free block
+    int bucket = get_bucket(space);
+    // the new block becomes the first node of its bucket
+    new_node->next = buckets[bucket];
+    new_node->prev = NULL;
+    // if there is a next block in the linked list
+    if (buckets[bucket] != NULL) {
+        node *next_node = (node *)buckets[bucket];
+        next_node->prev = new_node;  // make previous pointer of next block point to new free block
     }
-    make_free(location, count, next_block, prev_block);  // create new coalesced free block
+    buckets[bucket] = new_node;
+    nonempty_buckets |= 1UL << bucket;  // mark the bucket as containing a free block
 }
 
 /* Function: remove_free
 ------------------------------
-Given a pointer to a node of a free block, cur,  remove_free will remove that node from the free linked list.
+Given a pointer to a node of a free block, cur,  remove_free will remove that node from the free linked list of its bucket, or from the tree if the block is at least TREE_MIN_SIZE bytes, and take it out of the free block counts of stats.
 
-This function assumes that cur is a pointer toa  node in the linked free list.
+This function assumes that cur is a pointer toa  node in one of the free linked lists or the tree and that the header before cur still holds the size the block was added with.
 */
 
 void remove_free(node *cur) {
+    stats.free_blocks--;
+    stats.free_bytes -= get_size((char *)cur - BLOCK_SIZE);
+    if (get_size((char *)cur - BLOCK_SIZE) >= TREE_MIN_SIZE) {
+        tree_remove((tree_node *)cur);
+        return;
+    }
     node *next_block = (node *)(cur->next);  // find the next node
     node *prev_block = (node *)(cur->prev);  // find the previous node
     // if there is a previous node
     if (prev_block != NULL) {
         prev_block->next = next_block;  // make previous node point past the inputted node
-        // if we are removing the first node
+        // if we are removing the first node of the bucket
     } else {
-        // if the node we are removing is the only node in the free list
+        int bucket = get_bucket(get_size((char *)cur - BLOCK_SIZE));
+        buckets[bucket] = next_block;  // the next node becomes the first node of the bucket
+        // if the node we are removing is the only node in the bucket
         if (next_block == NULL) {
-            first_free = (char *)segment_start + segment_size;  // update first_free to point to end of heap
-            // there is another node that we are removing
-        } else {
-            first_free = (char *)next_block - BLOCK_SIZE;  // update first free to point after the node we remove
+            nonempty_buckets &= ~(1UL << bucket);
         }
     }
     //  if there is a node after the node we are removing
@@ -138,291 +539,1558 @@ void remove_free(node *cur) {
     }
 }
 
-/* given a pointer, headerptr, and a requested size, allocated_size, make_used will change the header pointed to by headerptr to indicate a used block in memory with allocated_size bytes.
+/* Function: absorb_next
+--------------------------------
+Given a pointer to the header of a block, location, and its current payload size, space, absorb_next removes the free block that directly follows the block in the heap, if there is one, from the free lists, and returns the payload size the block would have after merging with it.  The header at location is not changed.
 
-This function assumes that headerptr points to a header in the heap and that allocated_size is alligned and greater than MIN_BLOCK.
+This function assumes that location points to a header in the heap.
 */
 
-void make_used(void *location, size_t allocated_size) {
-    header *headerptr = (header *)location;
-    headerptr->size = allocated_size + 1;  // add one to indicate a used block
+size_t absorb_next(void *location, size_t space) {
+    void *end_heap = (char *)segment_start + segment_size;  // the other chunks end in an epilogue, which is never free
+    void *next_location = (char *)location + BLOCK_SIZE + space;
+    // free blocks are never next to each other, so there is at most one block to merge
+    if (next_location != end_heap && is_free(next_location)) {
+        remove_free((node *)((char *)next_location + BLOCK_SIZE));  // the block is merged, so take it off its list
+        space += BLOCK_SIZE + get_size(next_location);  // update total space of coalesced blocks
+    }
+    return space;
 }
 
-/* Function: myinit
-------------------------------
-Given a pointer to the start of the heap, heap_start, and the size of the heap, heap_size, myinit intializes heap_size bytes of memory starting at heap_Start to be used as the heap.  Thsi is done by updateing global variables that refer to the size and start of the heap.  Subsequent calls to myinit will clear the ucrrent heap and reinialize a new heap with the inputted parameaters. myinit will return false if the inputted size is too small for the heap allcoator to use, and otherwise will return true.
+/* Function: is_zeroed
+--------------------------------
+Given a pointer to the header of a free block, location, is_zeroed returns true if the block is in the tree and is marked zeroed.
+*/
 
-This function assumes that heap_Start is a non null point that is alligned with the ALIGNMENT constant, and that heap_size is a multiple of ALIGNMENT.
+bool is_zeroed(void *location) {
+    return get_size(location) >= TREE_MIN_SIZE && ((tree_node *)((char *)location + BLOCK_SIZE))->zeroed;
+}
+
+/* Function: keep_zeroed
+--------------------------------
+Given a pointer to the header of a used block that was just split off a zeroed free block, location, keep_zeroed marks the leftover free block right after it as zeroed too, if there is one and it is in the tree.  The bytes before the leftover cover the tree node of the old block, so all of the leftover's payload except its own node and footer is still zero.
 */
 
-bool myinit(void *heap_start, size_t heap_size) {
-    // if the heapsize is less than MIN_BLOCK, there is not enough memory to hold a header and a node
-    if (heap_size <= 2 * BLOCK_SIZE) {
-        return false;
+void keep_zeroed(void *location) {
+    void *end_heap = (char *)segment_start + segment_size;  // the other chunks end in an epilogue, which is never free
+    void *rest = (char *)location + BLOCK_SIZE + get_size(location);
+    if (rest != end_heap && is_free(rest) && get_size(rest) >= TREE_MIN_SIZE) {
+        ((tree_node *)((char *)rest + BLOCK_SIZE))->zeroed = true;
     }
-    segment_start = heap_start;
-    segment_size = heap_size;
-    first_free = segment_start;  // set first_free to point to begginging of heap as that is first free block
-    header *first_header = (header *)segment_start;
-    first_header->size = segment_size - BLOCK_SIZE;  // intialize header indicating that the whole block is free to use
-    node *first_node = (node *)((char *)segment_start + BLOCK_SIZE);  // create first node in free linked list
-    first_node->next = NULL;  // only free node so next and prev are NULL
-    first_node->prev = NULL;
-    return true;
 }
 
-/* Function: mymalloc
---------------------------
-Given a number of bytes, requested_size, mymalloc will return a pointer to an adress in the heap that contains an alligned requested_size number of bytes to be used by the caller.  If the requested_size is 0 or there is not enough free memory in the heap to accomodate the user's request, mymalloc will return a null pointer.  If the user inputs a size less than MIN_BLOCK, mymalloc will allocate MIN_BLOCK number of bytes.
+/* Function: release_pages
+--------------------------------
+Given a pointer to the header of a free block, location, and the first and last byte past the range of its payload that may not be zero, start and end, release_pages tells the kernel it can take back every whole page of that range, and clears the bytes of the range on the pages at either end, so that the whole range is zero afterwards.  The bytes the free block uses for its tree node and footer are never released.  It returns false if the pages could not be released.
+
+This function assumes that location is a free block that is already in the tree.
 */
 
-void *mymalloc(size_t requested_size) {
-    // if input is 0
-    if (requested_size == 0) {
-        return NULL;
+bool release_pages(void *location, char *start, char *end) {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    char *payload = (char *)location + BLOCK_SIZE;
+    char *first = payload + sizeof(tree_node);  // the tree node at the start of the payload must be kept
+    char *last = payload + get_size(location) - BLOCK_SIZE;  // and so must the footer at its end
+    if (start < first) {
+        start = first;
     }
-    void *result = NULL;
-    // if input is less than MIN_BLOCK
-    if (requested_size < MIN_BLOCK) {
-        requested_size = MIN_BLOCK;
+    if (end > last) {
+        end = last;
     }
-    size_t needed = roundup(requested_size, ALIGNMENT);  // round how many bytes we need in memory
-    node *temp = (node *)((char *)first_free + BLOCK_SIZE);  // create a temp variable to traverse the free linked list
-    // while there are still free blocks
-    while (temp != NULL) {
-        header *free_header = (header *)((char *)temp - BLOCK_SIZE);
-        size_t free_space = free_header->size;  // amount of space in the free block
-        // if we have enough space in block to accomodate allocate request
-        if (needed <= free_space) {
-            long leftover_space = free_space - (needed + 2 * BLOCK_SIZE);  // we cannot leave 2 * BLOCK_SIZE bytes only
-            result = temp;  // update result to point to memory where allocation will occur
-            //  if there is enough space to allocate and we have to create free block
-            if (leftover_space > 0) {
-                // store  pointers of the current free header to use to update linked list with new created free block
-                void *next_block = temp->next;  
-                void *prev_block = temp->prev;
-                make_used((char *)temp - BLOCK_SIZE, needed);  // make block used
-                // create a free block with leftover space
-                make_free((char *)temp + needed, (free_space - needed - BLOCK_SIZE), next_block, prev_block);
-                // coalesce newly created free block
-                coalesce((char *)temp + needed);
-                return result;
-                // do not have enough space to create a free block
-            } else {
-                remove_free(temp);  // remove free block and update linked list
-                make_used((char *)temp - BLOCK_SIZE, free_space);  // make entire free block used
-                return result;
-            }
-            // not enough space in free block for allocation request
-        } else {
-            temp = (node *)(temp->next);  // skip to next free block in linked list
-        }
+    if (start >= end) {
+        return true;
     }
-    return result;
+    char *first_page = (char *)roundup((uintptr_t)start, page_size);
+    char *last_page = (char *)((uintptr_t)end & ~(uintptr_t)(page_size - 1));
+    // if the range does not hold a whole page, it is cleared by hand
+    if (first_page >= last_page) {
+        memset(start, 0, end - start);
+        return true;
+    }
+    if (madvise(first_page, last_page - first_page, MADV_DONTNEED) != 0) {
+        return false;
+    }
+    memset(start, 0, first_page - start);
+    memset(last_page, 0, end - last_page);
+    return true;
 }
 
-/* Given a pointer to the heap, ptr, myfree will free the memory pointed to by the pointer so that it an be allocated again.  myfree will do nothing if given NULL ptr.
+/* Function: coalesce
+--------------------------------
+Given a pointer to a block that is not on any free list, location, and its payload size, space, coalesce will merge the block with the free blocks right before and right after it, if there are any, and add the resulting free block to the free lists.  The previous block is found in constant time through its footer.  If the merged block has at least RELEASE_MIN_SIZE bytes, the bytes of it that may not be zero are released and it is marked zeroed.  A zeroed neighbour only adds its tree node, header and footer to those bytes, so only the freed block and any other neighbours are given back.
 
-This function assumes ptr points to the first address of a previously allocated block.
+This function assumes that location points to the header of a block that is not on any free list, and that the PREV_FREE_BIT of that header is up to date.
 */
 
-void myfree(void *ptr) {
-    if (ptr == NULL) {
-        return;
+void coalesce(void *location, size_t space) {
+    char *dirty_start = (char *)location + BLOCK_SIZE;  // start of the bytes that may not be zero
+    char *dirty_end = (char *)location + BLOCK_SIZE + space;  // end of the bytes that may not be zero
+    size_t merged_space = absorb_next(location, space);
+    // the header and tree node of the block after are still in place after it is taken off the tree
+    if (merged_space > space) {
+        dirty_end = is_zeroed(dirty_end) ? dirty_end + BLOCK_SIZE + sizeof(tree_node) : (char *)location + BLOCK_SIZE + merged_space;
     }
-    void *end_heap = (char *)segment_start + segment_size;  // create a pointer to end of heap
-    ptr = (char *)ptr - BLOCK_SIZE;  // set ptr to used header
-    void *free_location = ptr;  // set free_location to used header because that is what we will make_free
-    size_t used_size = (((header *)free_location)->size) - 1;  // size of used block
-    // search for next free block before end of list
-    while (ptr < end_heap) {
-        // if we find a free block
-        if (is_free(ptr)) {
-            // use this free block to get pointers to previous free block to add in new free block
-            node *next_block = (node *)((char *)ptr + BLOCK_SIZE);
-            void *prev_block = next_block->prev;
-            make_free(free_location, used_size, next_block, prev_block);  // add in new free block
-            // coalesce new free block
-            coalesce(free_location);
-            return;
-            // if next header is not free
-        } else {
-            header *cur_header = (header *)ptr;
-            size_t jump_space = cur_header->size + BLOCK_SIZE - 1;  
-            ptr = (char *)ptr + jump_space;  // jump to next header
-        }
+    space = merged_space;
+    // if the block before is free, the merged block starts at its header
+    if (prev_is_free(location)) {
+        size_t prev_space = ((footer *)((char *)location - BLOCK_SIZE))->size;
+        void *prev_location = (char *)location - BLOCK_SIZE - prev_space;
+        // of a zeroed block before, only its footer is not zero, and its tree node becomes the node of the merged block
+        dirty_start = is_zeroed(prev_location) ? (char *)location - BLOCK_SIZE : (char *)prev_location + BLOCK_SIZE;
+        location = prev_location;
+        remove_free((node *)((char *)location + BLOCK_SIZE));
+        space += BLOCK_SIZE + prev_space;
     }
-    //  if there are free blocks after the location we are freeing
-    //  if there are no other free blocks in the heap
-    if (first_free == end_heap) {
-        make_free(free_location, used_size, NULL, NULL);  // make the only free block
-        // by freeing we are creating the last free block
-        // go through linked list to find current last free block to get pointers to update free linked list
-    } else {
-        node *temp = (node *)((char *)(first_free) + BLOCK_SIZE);  // first free node
-        // while there are still blocks in free linked list
-        while (temp->next != NULL) {
-            temp = (node *)(temp->next);  // move to next free block
-        }
-        make_free(free_location, used_size, temp->next, temp);  // make free using pointers from last free block of list
+    make_free(location, space);  // create new coalesced free block
+    if (space >= RELEASE_MIN_SIZE) {
+        ((tree_node *)((char *)location + BLOCK_SIZE))->zeroed = release_pages(location, dirty_start, dirty_end);
     }
 }
 
-/* Function: myrealloc
------------------------------
-Given a pointer to the heap, old_ptr, and a size, new_size, myrealloc will change the old_ptr to point to the new_size amount of bytes and return old_ptr.  If there is not enough space at old_ptr for new_size amount of bytes, myrealloc will return a new pointer to a locaiton in the heap with new_size number of bytes and the memory from old_ptr copied.  myrealloc will then free the old memory used.  If there is not enough space in the heap for the request, myrealloc will not change the heap and return NULL.  If the inputted size is zero by realloc will free the meory pointed to by the inputted pointer.  If old_ptr is NULL, myrealloc will allocated new_size bytes of memory and will return the location of this memory on the heap.
+/* given a pointer, headerptr, and a requested size, allocated_size, make_used will change the header pointed to by headerptr to indicate a used block in memory with allocated_size bytes.  The PREV_FREE_BIT of the header is kept, and the following block is marked as having a used block before it.
 
-This function assumes that old_ptr points to the beggining of a previously allocated block of memory.
+This function assumes that headerptr points to a header in the heap and that allocated_size is alligned and greater than MIN_BLOCK.
 */
 
-void *myrealloc(void *old_ptr, size_t new_size) {
-    if (old_ptr == NULL) {
-        return mymalloc(new_size);
-    }
-    if (new_size == 0) {
-        myfree(old_ptr);
-        return NULL;
+void make_used(void *location, size_t allocated_size) {
+    header *headerptr = (header *)location;
+    // set the low bit to indicate a used block
+    headerptr->size = allocated_size | USED_BIT | (headerptr->size & PREV_FREE_BIT);
+    set_prev_free((char *)location + BLOCK_SIZE + allocated_size, false);
+}
+
+/* Function: split_used
+--------------------------------
+Given a pointer to the header of a block that is not on any free list, location, the total payload bytes available to it, space, and the payload bytes it needs, needed, split_used makes the block used with needed bytes and turns any leftover bytes into a free block.  If the leftover bytes are too few to hold a free block, the whole space is kept in the used block.
+
+This function assumes that needed <= space, that both are alligned, and that the block after the space is used.
+*/
+
+void split_used(void *location, size_t space, size_t needed) {
+    //  if there is enough space to allocate and we have to create free block
+    if (space >= needed + BLOCK_SIZE + MIN_BLOCK) {
+        make_used(location, needed);  // make block used
+        // create a free block with leftover space, the block after it is never free
+        make_free((char *)location + BLOCK_SIZE + needed, space - needed - BLOCK_SIZE);
+        // do not have enough space to create a free block
+    } else {
+        make_used(location, space);  // make entire free block used
     }
-    // if the requested size is less than MIN_BLOCK
-    if (new_size < MIN_BLOCK) {
-        new_size = MIN_BLOCK;
+}
+
+/* Function: find_fit
+--------------------------------
+Given an alligned number of bytes, needed, find_fit returns the node of a free block with at least needed bytes, or NULL if there is no such block.  Requests of at least TREE_MIN_SIZE bytes take the best fit from the tree.  For smaller requests, the search starts at the bucket for needed.  Every block in an exact-size bucket fits, and a power-of-two bucket is searched first fit.  If that bucket has no fit, the first block of the next non-empty bucket is returned, because every block there is larger than needed, and if there is none, the smallest block of the tree is used.
+*/
+
+node *find_fit(size_t needed) {
+    if (needed >= TREE_MIN_SIZE) {
+        return (node *)tree_best_fit(needed);
     }
-    size_t needed = roundup(new_size, ALIGNMENT);  // align the new_size
-    header *old_header = (header *)((char *)old_ptr - BLOCK_SIZE);
-    size_t free_space = old_header->size - 1;  // create a variable free space to keep track of space at old_ptr
-    void *temp = (char *)old_ptr + free_space;  // create variable temp to traverse headers of heap
-    void *result = NULL;
-    // if the allocated memory is followed by a free block
-    if (is_free(temp)) {
-        coalesce(temp);
-        header *free_header = (header *)temp;
-        free_space += BLOCK_SIZE + free_header->size;  // update free space to account for following free blocks
-        // if there is enough space for inplace realloc
-        if (needed <= free_space) {
-            // can't leave space for just 2 * BLOCK_SIZE bytes because this is less than MIN_BLOCK
-            long leftover_space = free_space - (needed + 2 * BLOCK_SIZE);
-            result = old_ptr;  // reallocating inplace so return same pointer
-            node *free_node = (node *)((char *)temp + BLOCK_SIZE);
-            // if space to create a free block after reallocation
-            if (leftover_space > 0) {
-                // use pointers from current free block to make new free block that fits in linked list
-                void *next_block = free_node->next;
-                void *prev_block = free_node->prev;
-                make_used((char *)old_ptr - BLOCK_SIZE, needed);
-                make_free((char *)old_ptr + needed, free_space - needed - BLOCK_SIZE, next_block, prev_block);
-                return result;
-                // not enough space for new free block after reallocation
-            } else {
-                remove_free(free_node);  // remove entire free block from linked list
-                make_used(old_header, free_space);  // make entire free block used
-                return result;
-            }
-            // if there is not enough space for inplace realloc
-        } else {
-            result = mymalloc(needed);  // allocate memory somewhere else
-            // if heap is exhasuted
-            if (result == NULL) {
-                return old_ptr;
-                // if space on heap for reallocation
-            } else {
-                memmove(result, old_ptr, old_header->size);  // copy memory to new location
-                myfree(old_ptr);  // free the old location
-                coalesce((char *)old_ptr - BLOCK_SIZE);  // coalesece newly freed block 
-                return result;  // return new location
-            }
-        }
-        // if used block is followed by another used block
-    } else {
-        // if we have space for inplace realloc
-        if (needed <= free_space) {
-            // we can't just leave space for < MIN_BLOCK bytes
-            long leftover_space = free_space - (needed + 2 * BLOCK_SIZE);
-            // have space for free block after reallocaiton
-            if (leftover_space > 0) {
-                make_used((char *)old_ptr - BLOCK_SIZE, needed);  // reallocate memory
-                // make the reamining memory used so that we can free it
-                make_used((char *)old_ptr + needed, free_space - needed - BLOCK_SIZE);
-                // free reaminign memory so that it is correctly included in free linked lsit
-                myfree((char *)old_ptr + needed + BLOCK_SIZE);
-                return old_ptr;
-                // if we dont need to create a free block
-            } else {
-                return old_ptr;  // we still need to reallocate the same amount as previously allocated
-            }
-            // if not enough space for inplace realloc
-        } else {
-            result = mymalloc(needed);  // allocate space somewhere else on heap
-            // if heap exhausted
-            if (result == NULL) {
-                return old_ptr;
-            } else {
-                memmove(result, old_ptr, old_header->size);  // copy memory to new location
-                myfree(old_ptr);  // free old allcoated space
-                return result;
-            }
+    int bucket = get_bucket(needed);
+    node *temp = (node *)buckets[bucket];  // create a temp variable to traverse the free linked list
+    // while there are still free blocks in the bucket
+    while (temp != NULL) {
+        stats.search_steps++;
+        // if we have enough space in block to accomodate allocate request
+        if (needed <= get_size((char *)temp - BLOCK_SIZE)) {
+            return temp;
         }
+        temp = (node *)(temp->next);  // skip to next free block in linked list
+    }
+    // look for the first non-empty bucket after this one
+    unsigned long larger = nonempty_buckets & (~0UL << (bucket + 1));
+    if (larger == 0) {
+        return (node *)tree_best_fit(needed);
     }
+    return (node *)buckets[__builtin_ctzl(larger)];
 }
-                
-/* Function: validate_heap
----------------------------------
-This function checks the internal structure of the heap by ensuring that all the memory of the heap is accounted for and that the free linked list contains all the free blocks in the correct order.  If there is memory that is not accounted for or a free block that is not on the list, or a node on the list that does not correspond to the correct free block, validate_heap returns false, otherwise if returns true.
+
+/* Function: grow_heap
+--------------------------
+Given an alligned number of bytes, needed, grow_heap maps a new chunk that can hold a free block of at least needed bytes and adds that block, marked zeroed, to the free lists.  The chunk is at least as big as the heap so far, so the number of chunks stays small as the heap grows.  It returns false if the chunk could not be mapped, which includes when segment.c already has as many chunks as it allows.  In a THREAD_SAFE build, the caller must hold the heap lock.
 */
 
-bool validate_heap() {
-    void *temp = segment_start;  // create a pointer to traverse headers of list
-    size_t count = 0;  // create a variable to count accounted for bytes
-    void *end_heap = (char *)segment_start + segment_size;
-    node *cur_node = (node *)((char *)first_free + BLOCK_SIZE);  // create a pointer to traverse free linked list
-    // while there are headers to be read
-    while (temp < end_heap) {
-        header *cur_header = (header *)temp;
-        size_t block_size = 0;
-        // if the header is free
-        if (is_free(temp)) {
-            block_size = cur_header->size + BLOCK_SIZE;
-            count += block_size;  // update the amount to account for free bytes
-            // if the current free block does not correspond to the current node in the free list
-            if (temp != ((char *)cur_node - BLOCK_SIZE)) {
-                return false;
-            } else {
-                cur_node = (node *)(cur_node->next);  // update node to point to next node in linked list
-            }
-        } else {
-            block_size = cur_header->size - 1 + BLOCK_SIZE;
-            count += block_size;  // update count to account for allocated bytes
-        }
-        temp = (char *)temp + block_size;  // point temp to next header
+bool grow_heap(size_t needed) {
+    size_t heap_size = 0;
+    for (int chunk = 0; chunk < heap_segment_chunks(); chunk++) {
+        heap_size += get_chunk_size(chunk);
     }
-    // if there are no more free blocks but more free nodes in the linked list
-    if (cur_node != NULL) {
+    size_t chunk_size = BLOCK_SIZE + needed + BLOCK_SIZE;  // a header, the free block, and the epilogue
+    if (chunk_size < heap_size) {
+        chunk_size = heap_size;
+    }
+    void *chunk = extend_heap_segment(chunk_size);
+    if (chunk == NULL) {
         return false;
     }
-    return (count == segment_size);  //  checks if memory used by the blocks equals the total memory
+    // the chunk may have been rounded up to whole pages, its last header is the epilogue
+    chunk_size = heap_chunk_size(heap_segment_chunks() - 1);
+    ((header *)((char *)chunk + chunk_size - BLOCK_SIZE))->size = USED_BIT;
+    ((header *)chunk)->size = 0;  // nothing comes before the first block of a chunk
+    make_free(chunk, chunk_size - 2 * BLOCK_SIZE);
+    ((tree_node *)((char *)chunk + BLOCK_SIZE))->zeroed = true;  // a new mapping is all zero
+    return true;
 }
 
-/* Function: dump_heap
- * -------------------
- * This function prints out the the block contents of the heap.  For all headers, this function prints out the pointer to the header, a character indicating that it is free or used, the size of the block, and the amount of bytes in hex until the next header.  If the header is free, dump_heap also prints out the current node, the next node, and the previous node in the free linked list.  dump_heap is not
- * called anywhere, but is a useful helper function to call from gdb when
- * tracing through programs.  It prints out the total range of the heap, and
+/* Function: take_free
+--------------------------
+Given the node of a free block, temp, and an alligned number of bytes that is at least MIN_BLOCK and no more than the block holds, needed, take_free takes the block off the free lists and makes it a used block with needed bytes, splitting off any leftover space.  If the free block was zeroed, so is the leftover.  It returns true if the free block was zeroed.
+*/
+
+bool take_free(node *temp, size_t needed) {
+    void *location = (char *)temp - BLOCK_SIZE;
+    bool zeroed = is_zeroed(location);
+    remove_free(temp);  // remove free block and update linked list
+    split_used(location, get_size(location), needed);
+    count_small(get_size(location), 1);
+    if (zeroed) {
+        keep_zeroed(location);
+    }
+    return zeroed;
+}
+
+/* Function: heap_malloc
+--------------------------
+Given an alligned number of bytes that is at least MIN_BLOCK, needed, heap_malloc takes a block with at least needed bytes off the free lists, splits off any leftover space, and returns a pointer to its payload.  If no free block is big enough, the heap is grown first, and NULL is returned only if it can not grow.  In a THREAD_SAFE build, the caller must hold the heap lock.
+*/
+
+void *heap_malloc(size_t needed) {
+    node *temp = find_fit(needed);
+    // if no free block is big enough, a new chunk will have one
+    if (temp == NULL && grow_heap(needed)) {
+        temp = find_fit(needed);
+    }
+    if (temp == NULL) {
+        return NULL;
+    }
+    take_free(temp, needed);
+    return temp;  // the payload starts where the node used to be
+}
+
+/* Function: heap_calloc
+--------------------------
+Given an alligned number of bytes that is at least MIN_BLOCK, needed, heap_calloc works like heap_malloc but returns a block whose needed bytes are all zero.  If the block comes from a zeroed free block, only the bytes of its old tree node, and its old footer if the whole free block was used, have to be cleared.  Otherwise the whole payload is cleared.  In a THREAD_SAFE build, the caller must hold the heap lock.
+*/
+
+void *heap_calloc(size_t needed) {
+    node *temp = find_fit(needed);
+    // if no free block is big enough, a new chunk will have one
+    if (temp == NULL && grow_heap(needed)) {
+        temp = find_fit(needed);
+    }
+    if (temp == NULL) {
+        return NULL;
+    }
+    void *location = (char *)temp - BLOCK_SIZE;
+    size_t space = get_size(location);
+    if (!take_free(temp, needed)) {
+        memset(temp, 0, needed);
+        return temp;
+    }
+    size_t used = get_size(location);
+    memset(temp, 0, (used < sizeof(tree_node)) ? used : sizeof(tree_node));
+    if (used == space) {
+        ((footer *)((char *)location + space))->size = 0;
+    }
+    return temp;
+}
+
+/* Function: heap_malloc_run
+--------------------------
+Given an alligned number of bytes that is at least MIN_BLOCK, needed, a number of blocks, count, and an array, out, heap_malloc_run takes one free block off the free lists and carves as many blocks of needed bytes out of it as it can hold, up to count, storing their payloads in out.  It first looks for a free block that holds the whole run, and then for any block that fits one, growing the heap for the run if neither exists.  The blocks are laid out back to back, so each one only needs its header written, and only the last one splits off the leftover space.  It returns the number of blocks carved, which is 0 only if the heap is exhausted.  In a THREAD_SAFE build, the caller must hold the heap lock.
+*/
+
+size_t heap_malloc_run(size_t needed, size_t count, void *out[]) {
+    size_t max_count = MAX_REQUEST_SIZE / (BLOCK_SIZE + needed);  // keeps the size of the run from overflowing
+    if (count > max_count) {
+        count = max_count;
+    }
+    size_t run = count * (BLOCK_SIZE + needed) - BLOCK_SIZE;  // payload bytes of a free block that holds every block
+    node *temp = find_fit(run);
+    if (temp == NULL) {
+        temp = find_fit(needed);
+    }
+    if (temp == NULL && grow_heap(run)) {
+        temp = find_fit(run);
+    }
+    if (temp == NULL) {
+        return 0;
+    }
+    void *location = (char *)temp - BLOCK_SIZE;
+    size_t space = get_size(location);
+    bool zeroed = is_zeroed(location);
+    remove_free(temp);
+    size_t carved = (space + BLOCK_SIZE) / (BLOCK_SIZE + needed);
+    if (carved > count) {
+        carved = count;
+    }
+    for (size_t i = 0; i + 1 < carved; i++) {
+        header *headerptr = (header *)location;
+        // only the first block can have a free block before it
+        headerptr->size = needed | USED_BIT | ((i == 0) ? (headerptr->size & PREV_FREE_BIT) : 0);
+        count_small(needed, 1);
+        out[i] = (char *)location + BLOCK_SIZE;
+        location = (char *)location + BLOCK_SIZE + needed;
+        space -= BLOCK_SIZE + needed;
+        ((header *)location)->size = 0;  // the next header is still free block payload, it has a used block before it
+    }
+    split_used(location, space, needed);
+    count_small(get_size(location), 1);
+    if (zeroed) {
+        keep_zeroed(location);
+    }
+    out[carved - 1] = (char *)location + BLOCK_SIZE;
+    return carved;
+}
+
+/* Function: heap_free
+--------------------------
+Given a pointer to the payload of a used block, ptr, heap_free merges the block with the free blocks right before and after it and pushes it onto the free list of its bucket.  In a THREAD_SAFE build, the caller must hold the heap lock.
+*/
+
+void heap_free(void *ptr) {
+    void *free_location = (char *)ptr - BLOCK_SIZE;  // set free_location to used header because that is what we will make_free
+    count_small(get_size(free_location), -1);
+    coalesce(free_location, get_size(free_location));
+}
+
+/* Function: heap_realloc
+-----------------------------
+Given a pointer to the payload of a used block, old_ptr, and an alligned number of bytes that is at least MIN_BLOCK, needed, heap_realloc resizes the block in place if the block and a free block following it have enough space.  Otherwise, if the free block before it, the block, and the free block after it have enough space together, the block grows backward: it takes over the free block before it and its payload slides down with one memmove.  Only if neither works is it moved to a new block.  It returns NULL and leaves the old block allocated if the heap is exhausted.  In a THREAD_SAFE build, the caller must hold the heap lock.
+*/
+
+void *heap_realloc(void *old_ptr, size_t needed) {
+    void *old_header = (char *)old_ptr - BLOCK_SIZE;
+    size_t old_size = get_size(old_header);  // create a variable to keep track of the payload at old_ptr
+    count_small(old_size, -1);  // the block is counted again with the size it ends up with
+    // merge a free block following the allocated memory, so we don't have to count it twice
+    size_t free_space = absorb_next(old_header, old_size);
+    // if there is enough space for inplace realloc
+    if (needed <= free_space) {
+        split_used(old_header, free_space, needed);
+        count_small(get_size(old_header), 1);
+        return old_ptr;  // reallocating inplace so return same pointer
+    }
+    // if the free block before makes enough space, grow backward into it
+    if (prev_is_free(old_header)) {
+        size_t prev_space = ((footer *)((char *)old_header - BLOCK_SIZE))->size;
+        size_t total_space = prev_space + BLOCK_SIZE + free_space;
+        if (needed <= total_space) {
+            void *location = (char *)old_header - BLOCK_SIZE - prev_space;
+            remove_free((node *)((char *)location + BLOCK_SIZE));  // before the payload overwrites its node
+            memmove((char *)location + BLOCK_SIZE, old_ptr, old_size);
+            split_used(location, total_space, needed);
+            count_small(get_size(location), 1);
+            return (char *)location + BLOCK_SIZE;
+        }
+    }
+    // the merged space is still part of the old block until it is freed
+    make_used(old_header, free_space);
+    count_small(free_space, 1);
+    void *result = heap_malloc(needed);  // allocate memory somewhere else
+    // if heap is exhasuted, the old block is left allocated
+    if (result == NULL) {
+        return NULL;
+    }
+    memmove(result, old_ptr, old_size);  // copy memory to new location
+    heap_free(old_ptr);  // free the old location
+    return result;  // return new location
+}
+
+/* Function: heap_malloc_aligned
+-----------------------------------
+Given a power of two, alignment, and an alligned number of bytes that is at least MIN_BLOCK, needed, heap_malloc_aligned takes a free block that can hold needed bytes starting at a multiple of alignment, and returns a pointer to a used block whose payload starts there.  The bytes before the aligned payload become a free block of their own instead of being wasted, and any leftover bytes after it are split off as usual.  Both stay zeroed if the free block was.  The heap is grown if no free block is big enough, and NULL is returned only if it can not grow.  In a THREAD_SAFE build, the caller must hold the heap lock.
+*/
+
+void *heap_malloc_aligned(size_t alignment, size_t needed) {
+    // a block this big can always fit the payload after a gap big enough to be a free block
+    size_t search = needed + alignment + BLOCK_SIZE + MIN_BLOCK;
+    node *temp = find_fit(search);
+    if (temp == NULL && grow_heap(search)) {
+        temp = find_fit(search);
+    }
+    if (temp == NULL) {
+        return NULL;
+    }
+    void *location = (char *)temp - BLOCK_SIZE;
+    size_t space = get_size(location);
+    bool zeroed = is_zeroed(location);
+    remove_free(temp);
+    char *payload = (char *)temp;
+    char *aligned = (char *)roundup((uintptr_t)payload, alignment);
+    // a gap before the aligned payload must be able to hold a header and a free block, which can take more than one step for small alignments
+    while (aligned != payload && aligned - payload < BLOCK_SIZE + MIN_BLOCK) {
+        aligned += alignment;
+    }
+    if (aligned != payload) {
+        make_free(location, aligned - payload - BLOCK_SIZE);  // the gap is a free block before the aligned block
+        // the gap keeps the tree node of the old block, so it is as zeroed as the old block was
+        if (zeroed && aligned - payload - BLOCK_SIZE >= TREE_MIN_SIZE) {
+            ((tree_node *)payload)->zeroed = true;
+        }
+    }
+    split_used(aligned - BLOCK_SIZE, payload + space - aligned, needed);
+    count_small(get_size(aligned - BLOCK_SIZE), 1);
+    if (zeroed) {
+        keep_zeroed(aligned - BLOCK_SIZE);
+    }
+    return aligned;
+}
+
+/* Function: is_mapped
+-----------------------------------
+Given a pointer to the payload of a block that is not a slab object, ptr, is_mapped returns true if the block has a mapping of its own instead of being part of the heap.
+*/
+
+bool is_mapped(void *ptr) {
+    return (((header *)((char *)ptr - BLOCK_SIZE))->size & MAPPED_BIT) != 0;
+}
+
+/* Function: map_block
+-----------------------------------
+Given an alligned number of bytes, needed, map_block maps a region of its own for a used block with needed bytes and returns a pointer to its payload.  It returns NULL if the region could not be mapped.  In a THREAD_SAFE build, the caller must hold the heap lock, since the list of regions is shared.
+*/
+
+void *map_block(size_t needed) {
+    header *headerptr = map_heap_region(BLOCK_SIZE + needed);
+    if (headerptr == NULL) {
+        return NULL;
+    }
+    headerptr->size = needed | USED_BIT | MAPPED_BIT;
+    num_mapped++;
+    return (char *)headerptr + BLOCK_SIZE;
+}
+
+/* Function: unmap_block
+-----------------------------------
+Given a pointer to the payload of a block with a mapping of its own, ptr, unmap_block gives the mapping back to the system.  In a THREAD_SAFE build, the caller must hold the heap lock.
+*/
+
+void unmap_block(void *ptr) {
+    unmap_heap_region((char *)ptr - BLOCK_SIZE);
+    num_mapped--;
+}
+
+/* Function: mapped_realloc
+-----------------------------------
+Given a pointer to the payload of a used block that is not a slab object, old_ptr, and an alligned number of bytes that is at least MIN_BLOCK, needed, mapped_realloc resizes a block that has a mapping of its own or is growing to MMAP_THRESHOLD bytes or more.  If the block has a mapping and still needs one, the mapping is resized with mremap, so its contents are not copied.  Otherwise the block moves between the heap and a mapping of its own with one copy.  It returns NULL and leaves the old block allocated if there is no room.  In a THREAD_SAFE build, the caller must hold the heap lock.
+*/
+
+void *mapped_realloc(void *old_ptr, size_t needed) {
+    void *old_header = (char *)old_ptr - BLOCK_SIZE;
+    size_t old_size = get_size(old_header);
+    if (is_mapped(old_ptr) && needed >= MMAP_THRESHOLD) {
+        header *headerptr = remap_heap_region(old_header, BLOCK_SIZE + needed);
+        if (headerptr == NULL) {
+            return NULL;
+        }
+        headerptr->size = needed | USED_BIT | MAPPED_BIT;
+        return (char *)headerptr + BLOCK_SIZE;
+    }
+    void *result = (needed >= MMAP_THRESHOLD) ? map_block(needed) : heap_malloc(needed);
+    if (result == NULL) {
+        return NULL;
+    }
+    memcpy(result, old_ptr, (old_size < needed) ? old_size : needed);  // copy memory to new location
+    if (is_mapped(old_ptr)) {
+        unmap_block(old_ptr);
+    } else {
+        heap_free(old_ptr);
+    }
+    return result;
+}
+
+/* Function: slab_page
+------------------------------
+Given a pointer, ptr, slab_page returns the index in slab_pages of the page holding ptr, counted from the page holding the start of the heap.  If the page is outside the range covered by slab_pages, it returns SLAB_MAP_PAGES.
+*/
+
+size_t slab_page(void *ptr) {
+    if (ptr < segment_start) {
+        return SLAB_MAP_PAGES;
+    }
+    size_t page = ((uintptr_t)ptr >> SLAB_SHIFT) - ((uintptr_t)segment_start >> SLAB_SHIFT);
+    return (page < SLAB_MAP_PAGES) ? page : SLAB_MAP_PAGES;
+}
+
+/* Function: in_slab
+------------------------------
+Given a pointer, ptr, in_slab returns true if ptr points into a page that holds a slab, and false if it points into an ordinary block.
+*/
+
+bool in_slab(void *ptr) {
+    size_t page = slab_page(ptr);
+    return page < SLAB_MAP_PAGES && ((slab_pages[page / 64] >> (page % 64)) & 1);
+}
+
+/* Function: get_slab
+------------------------------
+Given a pointer to an object in a slab, ptr, get_slab returns the slab at the start of the page holding it.
+*/
+
+slab *get_slab(void *ptr) {
+    return (slab *)((uintptr_t)ptr & ~(uintptr_t)(SLAB_SIZE - 1));
+}
+
+/* Function: slab_push
+------------------------------
+Given a slab, cur, slab_push adds it to the front of the list of partial slabs of its class.
+*/
+
+void slab_push(slab *cur) {
+    int class = slab_class(cur->object_size);
+    cur->prev = NULL;
+    cur->next = partial_slabs[class];
+    if (cur->next != NULL) {
+        cur->next->prev = cur;
+    }
+    partial_slabs[class] = cur;
+}
+
+/* Function: slab_unlink
+------------------------------
+Given a slab on the list of partial slabs of its class, cur, slab_unlink removes it from that list.
+*/
+
+void slab_unlink(slab *cur) {
+    if (cur->prev != NULL) {
+        cur->prev->next = cur->next;
+    } else {
+        partial_slabs[slab_class(cur->object_size)] = cur->next;
+    }
+    if (cur->next != NULL) {
+        cur->next->prev = cur->prev;
+    }
+}
+
+/* Function: mark_slab_page
+------------------------------
+Given the start of a slab, cur, and whether the page now holds a slab, is_slab, mark_slab_page sets or clears the bit of the page in slab_pages.
+
+This function assumes that the page is in the range covered by slab_pages.
+*/
+
+void mark_slab_page(slab *cur, bool is_slab) {
+    size_t page = slab_page(cur);
+    if (is_slab) {
+        slab_pages[page / 64] |= 1UL << (page % 64);
+        if (page / 64 + 1 > slab_pages_used) {
+            slab_pages_used = page / 64 + 1;
+        }
+        num_slabs++;
+    } else {
+        slab_pages[page / 64] &= ~(1UL << (page % 64));
+        num_slabs--;
+    }
+}
+
+/* Function: new_slab
+------------------------------
+Given a slab class, class, new_slab takes a page-aligned block of SLAB_SIZE bytes from the heap, sets it up as an empty slab of that class, and adds it to the list of partial slabs.  It returns NULL if the heap has no room for a slab or the room it has is outside the range covered by slab_pages.  In a THREAD_SAFE build, the caller must hold the heap lock.
+*/
+
+slab *new_slab(int class) {
+    slab *cur = heap_malloc_aligned(SLAB_SIZE, SLAB_SIZE);
+    if (cur == NULL) {
+        return NULL;
+    }
+    if (slab_page(cur) == SLAB_MAP_PAGES) {
+        heap_free(cur);
+        return NULL;
+    }
+    cur->object_size = (class + 1) * ALIGNMENT;
+    cur->nobjects = (SLAB_SIZE - SLAB_HEADER) / cur->object_size;
+    cur->nfree = cur->nobjects;
+    // mark objects 0 to nobjects - 1 as free
+    memset(cur->free_map, 0, sizeof(cur->free_map));
+    for (int i = 0; i < cur->nobjects; i++) {
+        cur->free_map[i / 64] |= 1UL << (i % 64);
+    }
+    mark_slab_page(cur, true);
+    slab_push(cur);
+    return cur;
+}
+
+/* Function: slab_malloc
+------------------------------
+Given a slab class, class, slab_malloc returns a free object from a partial slab of that class, making a new slab if there is none.  A new slab is only made once small_live counts enough objects of the class's size to fill one, so a size that has few objects keeps getting heap blocks instead of pinning a page.  It returns NULL if the class has too few objects for a slab or no slab could be made.  In a THREAD_SAFE build, the caller must hold the heap lock.
+*/
+
+void *slab_malloc(int class) {
+    slab *cur = partial_slabs[class];
+    size_t object_size = (class + 1) * ALIGNMENT;
+    if (cur == NULL) {
+        size_t live = small_live[slab_class((object_size < MIN_BLOCK) ? MIN_BLOCK : object_size)];
+        if (live < (SLAB_SIZE - SLAB_HEADER) / object_size || (cur = new_slab(class)) == NULL) {
+            return NULL;
+        }
+    }
+    // take the lowest free object of the slab
+    int word = 0;
+    while (cur->free_map[word] == 0) {
+        word++;
+    }
+    int bit = __builtin_ctzl(cur->free_map[word]);
+    cur->free_map[word] &= ~(1UL << bit);
+    // a slab with no free objects left is taken off the partial list
+    if (--cur->nfree == 0) {
+        slab_unlink(cur);
+    }
+    count_small(object_size, 1);
+    return (char *)cur + SLAB_HEADER + (word * 64 + bit) * object_size;
+}
+
+/* Function: slab_free
+------------------------------
+Given a pointer to an object in a slab, ptr, slab_free marks the object free again.  A slab that becomes empty is returned to the heap, unless it is the only partial slab of its class, which is kept so that a class that allocates and frees one object at a time does not make a new slab on every call.  In a THREAD_SAFE build, the caller must hold the heap lock.
+*/
+
+void slab_free(void *ptr) {
+    slab *cur = get_slab(ptr);
+    count_small(cur->object_size, -1);
+    int index = ((char *)ptr - (char *)cur - SLAB_HEADER) / cur->object_size;
+    cur->free_map[index / 64] |= 1UL << (index % 64);
+    // a full slab has a free object again, so it goes back on the partial list
+    if (cur->nfree++ == 0) {
+        slab_push(cur);
+    }
+    if (cur->nfree == cur->nobjects && (cur->prev != NULL || cur->next != NULL)) {
+        slab_unlink(cur);
+        mark_slab_page(cur, false);
+        heap_free(cur);
+    }
+}
+
+/* Function: release_block
+------------------------------
+Given a pointer to an allocated object or block, ptr, release_block frees it through slab_free, unmap_block or heap_free, depending on whether it is a slab object, a block with a mapping of its own, or a block of the heap.  In a THREAD_SAFE build, the caller must hold the heap lock.
+*/
+
+void release_block(void *ptr) {
+    if (in_slab(ptr)) {
+        slab_free(ptr);
+    } else if (is_mapped(ptr)) {
+        unmap_block(ptr);
+    } else {
+        heap_free(ptr);
+    }
+}
+
+/* Function: usable_size
+------------------------------
+Given a pointer to an allocated object or block, ptr, usable_size returns the number of bytes the caller can use at ptr: the object size of its slab class for a slab object, and the payload size in its header for any other block.
+*/
+
+size_t usable_size(void *ptr) {
+    if (in_slab(ptr)) {
+        return get_slab(ptr)->object_size;
+    }
+    return get_size((char *)ptr - BLOCK_SIZE);
+}
+
+/* Function: count_malloc
+------------------------------
+Given a block that was just handed out, or NULL, ptr, count_malloc adds the block to the malloc count and the allocated bytes of stats.  In a THREAD_SAFE build, the caller must hold the heap lock.
+*/
+
+void count_malloc(void *ptr) {
+    if (ptr != NULL) {
+        stats.mallocs++;
+        stats.allocated_bytes += usable_size(ptr);
+    }
+}
+
+/* Function: count_free
+------------------------------
+Given a block that is about to be freed, ptr, count_free adds it to the free count of stats and takes it out of the allocated bytes.  In a THREAD_SAFE build, the caller must hold the heap lock.
+*/
+
+void count_free(void *ptr) {
+    stats.frees++;
+    stats.allocated_bytes -= usable_size(ptr);
+}
+
+#ifdef THREAD_SAFE
+
+/* Function: cache_discard_stale
+----------------------------------
+If myinit has reset the heap since this thread last used its cache, cache_discard_stale empties the cache, because the cached blocks belonged to the old heap.
+*/
+
+void cache_discard_stale() {
+    unsigned long generation = __atomic_load_n(&heap_generation, __ATOMIC_ACQUIRE);
+    if (thread_cache.generation != generation) {
+        memset(&thread_cache, 0, sizeof(thread_cache));
+        thread_cache.generation = generation;
+    }
+}
+
+/* Function: cache_flush_stats
+----------------------------------
+This function adds the counts of the calls this thread's cache served without the heap lock to stats, and clears them.  The caller must hold the heap lock.
+*/
+
+void cache_flush_stats() {
+    stats.mallocs += thread_cache.pending.mallocs;
+    stats.frees += thread_cache.pending.frees;
+    stats.reallocs += thread_cache.pending.reallocs;
+    stats.allocated_bytes += thread_cache.pending.allocated_bytes;  // wraps back around if the thread freed more than it allocated
+    memset(&thread_cache.pending, 0, sizeof(thread_cache.pending));
+}
+
+/* Function: cache_class_size
+----------------------------------
+Given a cache class, class, cache_class_size returns the usable size of the blocks it holds.
+*/
+
+size_t cache_class_size(int class) {
+    if (class < NUM_SLAB_CLASSES) {
+        return (class + 1) * ALIGNMENT;
+    }
+    return (class - NUM_SLAB_CLASSES) * ALIGNMENT + MIN_BLOCK;
+}
+
+/* Function: cache_drain
+----------------------------------
+Given a size class, class, cache_drain returns up to CACHE_BATCH blocks of that class from this thread's cache to the shared heap, taking the heap lock once for the whole batch.
+*/
+
+void cache_drain(int class) {
+    pthread_mutex_lock(&heap_lock);
+    cache_flush_stats();
+    for (int i = 0; i < CACHE_BATCH && thread_cache.heads[class] != NULL; i++) {
+        cached_block *block = thread_cache.heads[class];
+        thread_cache.heads[class] = block->next;
+        thread_cache.counts[class]--;
+        release_block(block);
+    }
+    pthread_mutex_unlock(&heap_lock);
+}
+
+/* Function: cache_push
+----------------------------------
+Given an allocated object or block, ptr, and the cache class it belongs in, class, cache_push puts it in this thread's cache, counts it as freed in the cache's pending counts, and returns a batch of the class to the shared heap if the cache is over capacity.
+*/
+
+void cache_push(void *ptr, int class) {
+    cache_discard_stale();
+    thread_cache.pending.frees++;
+    thread_cache.pending.allocated_bytes -= cache_class_size(class);
+    cached_block *block = (cached_block *)ptr;
+    block->next = thread_cache.heads[class];
+    thread_cache.heads[class] = block;
+    // if the cache is over capacity, give a batch back to the shared heap
+    if (++thread_cache.counts[class] > CACHE_CAPACITY) {
+        cache_drain(class);
+    }
+}
+
+/* Function: cache_exit
+----------------------------------
+This function is called when a thread that used the allocator exits, and drains every block left in the thread's cache back to the shared heap so that it is not lost, along with the counts the cache has not added to stats yet.
+*/
+
+void cache_exit(void *unused) {
+    // a cache left over from an old heap holds nothing to give back
+    if (thread_cache.generation != __atomic_load_n(&heap_generation, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    for (int class = 0; class < NUM_CACHE_CLASSES; class++) {
+        while (thread_cache.heads[class] != NULL) {
+            cache_drain(class);
+        }
+    }
+    // the calls served since the last drain or refill still have to be counted
+    pthread_mutex_lock(&heap_lock);
+    cache_flush_stats();
+    pthread_mutex_unlock(&heap_lock);
+}
+
+/* Function: cache_make_key
+----------------------------------
+This function runs once per process and creates the thread-specific key whose destructor drains a thread's cache when the thread exits.
+*/
+
+void cache_make_key() {
+    pthread_key_create(&cache_key, cache_exit);
+}
+
+/* Functions: fork_prepare, fork_parent, fork_child
+----------------------------------
+These functions are registered with pthread_atfork by myinit.  fork_prepare takes the heap lock before a fork, so no other thread is in the middle of changing the heap when it is copied, and fork_parent releases it again in the parent.  The child only has the thread that forked, so fork_child gives it a fresh heap lock that nobody holds instead of one held by a thread that does not exist there.
+*/
+
+void fork_prepare() {
+    pthread_mutex_lock(&heap_lock);
+}
+
+void fork_parent() {
+    pthread_mutex_unlock(&heap_lock);
+}
+
+void fork_child() {
+    pthread_mutex_init(&heap_lock, NULL);
+}
+
+/* Function: fork_register
+----------------------------------
+This function runs once per process and registers the fork handlers of the heap lock.
+*/
+
+void fork_register() {
+    pthread_atfork(fork_prepare, fork_parent, fork_child);
+}
+
+/* Function: cache_class
+----------------------------------
+Given an allocated object or block, ptr, cache_class returns the cache class it belongs in, or -1 if it is too big to be cached.
+*/
+
+int cache_class(void *ptr) {
+    if (in_slab(ptr)) {
+        return slab_class(get_slab(ptr)->object_size);
+    }
+    size_t size = get_size((char *)ptr - BLOCK_SIZE);
+    return (size <= MAX_EXACT_SIZE) ? NUM_SLAB_CLASSES + get_bucket(size) : -1;
+}
+
+/* Function: cache_refill
+----------------------------------
+Given a cache class, class, cache_refill takes the heap lock once and moves up to CACHE_BATCH objects of that class from the shared heap into this thread's cache.  Slab classes are refilled from slabs, and the other classes with blocks of exactly the size of their bucket.  It returns false if the heap could not supply a single object.
+*/
+
+bool cache_refill(int class) {
+    pthread_once(&cache_key_once, cache_make_key);
+    pthread_setspecific(cache_key, &thread_cache);  // register the thread so its cache is drained when it exits
+    size_t needed = cache_class_size(class);  // block size of the bucket of a non-slab class
+    pthread_mutex_lock(&heap_lock);
+    cache_flush_stats();
+    for (int i = 0; i < CACHE_BATCH; i++) {
+        void *ptr = (class < NUM_SLAB_CLASSES) ? slab_malloc(class) : heap_malloc(needed);
+        if (ptr == NULL) {
+            break;
+        }
+        // a block that kept extra leftover bytes does not belong to this class
+        if (class >= NUM_SLAB_CLASSES && get_size((char *)ptr - BLOCK_SIZE) != needed) {
+            heap_free(ptr);
+            break;
+        }
+        cached_block *block = (cached_block *)ptr;
+        block->next = thread_cache.heads[class];
+        thread_cache.heads[class] = block;
+        thread_cache.counts[class]++;
+    }
+    pthread_mutex_unlock(&heap_lock);
+    return thread_cache.heads[class] != NULL;
+}
+
+#endif
+
+/* Function: myinit
+------------------------------
+Given a pointer to the start of the heap, heap_start, and the size of the heap, heap_size, myinit intializes heap_size bytes of memory starting at heap_Start to be used as the heap.  Thsi is done by updateing global variables that refer to the size and start of the heap.  Subsequent calls to myinit will clear the ucrrent heap and reinialize a new heap with the inputted parameaters. myinit will return false if the inputted size is too small for the heap allcoator to use, and otherwise will return true.  In a THREAD_SAFE build, myinit also invalidates the caches of every thread, and must not run while other threads are using the allocator.  The first call also registers fork handlers, so a child forked while another thread holds the heap lock can still allocate.
+
+This function assumes that heap_Start is a non null point that is alligned with the ALIGNMENT constant, and that heap_size is a multiple of ALIGNMENT.
+*/
+
+bool myinit(void *heap_start, size_t heap_size) {
+    // if the heapsize is less than a header and MIN_BLOCK, there is not enough memory to hold a free block
+    if (heap_size < BLOCK_SIZE + MIN_BLOCK) {
+        return false;
+    }
+#ifdef THREAD_SAFE
+    pthread_once(&fork_once, fork_register);
+#endif
+    LOCK_HEAP();
+    segment_start = heap_start;
+    segment_size = heap_size;
+    // the heap starts as one chunk, chunks added to an earlier heap are unmapped
+    release_heap_chunks();
+    // unmap the blocks that had a mapping of their own in the old heap
+    for (void *region = heap_region_next(NULL); region != NULL; region = heap_region_next(NULL)) {
+        unmap_heap_region(region);
+    }
+    num_mapped = 0;
+    // empty every bucket
+    memset(buckets, 0, sizeof(buckets));
+    nonempty_buckets = 0;
+    tree_root = NULL;
+    // forget every slab, only the words of slab_pages that were used need clearing
+    memset(partial_slabs, 0, sizeof(partial_slabs));
+    memset(slab_pages, 0, slab_pages_used * sizeof(unsigned long));
+    slab_pages_used = 0;
+    num_slabs = 0;
+    memset(small_live, 0, sizeof(small_live));
+    memset(&stats, 0, sizeof(stats));
+    make_free(segment_start, segment_size - BLOCK_SIZE);  // intialize one free block that holds the whole heap
+    // a segment fresh from segment.c has never been written, so the block is zero
+    if (heap_segment_fresh(heap_start) && segment_size - BLOCK_SIZE >= TREE_MIN_SIZE) {
+        ((tree_node *)((char *)segment_start + BLOCK_SIZE))->zeroed = true;
+    }
+#ifdef THREAD_SAFE
+    __atomic_add_fetch(&heap_generation, 1, __ATOMIC_RELEASE);  // blocks cached by any thread belong to the old heap
+#endif
+    UNLOCK_HEAP();
+    return true;
+}
+
+/* Function: mymalloc
+--------------------------
+Given a number of bytes, requested_size, mymalloc will return a pointer to an adress in the heap that contains an alligned requested_size number of bytes to be used by the caller.  If the requested_size is 0 or there is not enough free memory in the heap to accomodate the user's request, mymalloc will return a null pointer.  Requests of at most MAX_SLAB_OBJECT bytes are served from a slab of their size class.  For other requests, if the user inputs a size less than MIN_BLOCK, mymalloc will allocate MIN_BLOCK number of bytes.  In a THREAD_SAFE build, small requests are served from the calling thread's cache without taking the heap lock.
+*/
+
+void *mymalloc(size_t requested_size) {
+    // if input is 0 or too big to ever be satisfied
+    if (requested_size == 0 || requested_size > MAX_REQUEST_SIZE) {
+        return NULL;
+    }
+    // huge requests get a mapping of their own
+    if (requested_size >= MMAP_THRESHOLD) {
+        LOCK_HEAP();
+        void *result = map_block(roundup(requested_size, ALIGNMENT));
+        count_malloc(result);
+        UNLOCK_HEAP();
+        return result;
+    }
+#ifdef THREAD_SAFE
+    // small sizes are the slab classes and exact-size buckets, so each one is a cache class
+    int class = -1;
+    if (requested_size <= MAX_SLAB_OBJECT) {
+        class = slab_class(requested_size);
+    } else if (requested_size <= MAX_EXACT_SIZE) {
+        class = NUM_SLAB_CLASSES + get_bucket(roundup(requested_size, ALIGNMENT));
+    }
+    if (class >= 0) {
+        cache_discard_stale();
+        // a size whose slab class has no objects to give, as before it has slabs, takes blocks of its exact-size bucket
+        if (class < NUM_SLAB_CLASSES && thread_cache.heads[class] == NULL) {
+            int bucket_class = NUM_SLAB_CLASSES + get_bucket(roundup((requested_size < MIN_BLOCK) ? MIN_BLOCK : requested_size, ALIGNMENT));
+            if (thread_cache.heads[bucket_class] != NULL || !cache_refill(class)) {
+                class = bucket_class;
+            }
+        }
+        if (thread_cache.heads[class] != NULL || cache_refill(class)) {
+            cached_block *block = thread_cache.heads[class];
+            thread_cache.heads[class] = block->next;
+            thread_cache.counts[class]--;
+            thread_cache.pending.mallocs++;
+            thread_cache.pending.allocated_bytes += cache_class_size(class);
+            return block;
+        }
+    }
+#endif
+    LOCK_HEAP();
+    void *result = NULL;
+    if (requested_size <= MAX_SLAB_OBJECT) {
+        result = slab_malloc(slab_class(requested_size));
+    }
+    // if the request is too big for a slab, or there was no room for a new slab
+    if (result == NULL) {
+        // if input is less than MIN_BLOCK
+        if (requested_size < MIN_BLOCK) {
+            requested_size = MIN_BLOCK;
+        }
+        result = heap_malloc(roundup(requested_size, ALIGNMENT));  // round how many bytes we need in memory
+    }
+    count_malloc(result);
+    UNLOCK_HEAP();
+    return result;
+}
+
+/* Given a pointer to the heap, ptr, myfree will free the memory pointed to by the pointer so that it an be allocated again.  A slab object is marked free in its slab.  Any other freed block is merged with the free blocks right before and after it and pushed onto the free list of its bucket, so no list or heap traversal is needed.  In a THREAD_SAFE build, small blocks go to the calling thread's cache instead, and are returned to the heap in batches once the cache is full.  myfree will do nothing if given NULL ptr.
+
+This function assumes ptr points to the first address of a previously allocated block.
+*/
+
+void myfree(void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+#ifdef THREAD_SAFE
+    int class = cache_class(ptr);
+    if (class >= 0) {
+        cache_push(ptr, class);
+        return;
+    }
+#endif
+    LOCK_HEAP();
+    count_free(ptr);
+    release_block(ptr);
+    UNLOCK_HEAP();
+}
+
+/* Function: mymemalign
+--------------------------
+Given a power of two, alignment, and a number of bytes, requested_size, mymemalign returns a pointer to a block of requested_size bytes that starts at a multiple of alignment.  Alignments of at most ALIGNMENT are met by every block, so those requests are passed to mymalloc.  Other requests are always placed in the heap by heap_malloc_aligned, even if they are at least MMAP_THRESHOLD bytes, because a region's payload starts a fixed distance into its first page.  The bytes skipped to reach the alignment become a free block instead of being wasted.  mymemalign returns NULL if requested_size is 0, alignment is not a power of two, or there is not enough room.
+*/
+
+void *mymemalign(size_t alignment, size_t requested_size) {
+    // if input is 0, too big to ever be satisfied, or the alignment is not a power of two
+    if (requested_size == 0 || requested_size > MAX_REQUEST_SIZE || alignment > MAX_REQUEST_SIZE ||
+        (alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+    if (alignment <= ALIGNMENT) {
+        return mymalloc(requested_size);
+    }
+    // if input is less than MIN_BLOCK
+    if (requested_size < MIN_BLOCK) {
+        requested_size = MIN_BLOCK;
+    }
+    LOCK_HEAP();
+    void *result = heap_malloc_aligned(alignment, roundup(requested_size, ALIGNMENT));
+    count_malloc(result);
+    UNLOCK_HEAP();
+    return result;
+}
+
+/* Function: myfree_sized
+--------------------------
+Given a pointer to an allocated block, ptr, and the size it was requested with, or any size up to what mymalloc_usable_size returns for it, size, myfree_sized frees the block like myfree.  size gives the class and object size of a slab object without reading its slab, and only a size of at least MMAP_THRESHOLD can belong to a block with a mapping of its own.  myfree_sized will do nothing if given NULL ptr.
+*/
+
+void myfree_sized(void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return;
+    }
+    bool slab_object = size <= MAX_SLAB_OBJECT && in_slab(ptr);
+    void *location = (char *)ptr - BLOCK_SIZE;
+#ifdef THREAD_SAFE
+    if (slab_object) {
+        cache_push(ptr, slab_class(size));
+        return;
+    }
+    // blocks of an exact-size bucket are cached
+    if (get_size(location) <= MAX_EXACT_SIZE) {
+        cache_push(ptr, NUM_SLAB_CLASSES + get_bucket(get_size(location)));
+        return;
+    }
+#endif
+    LOCK_HEAP();
+    stats.frees++;
+    if (slab_object) {
+        stats.allocated_bytes -= roundup(size, ALIGNMENT);
+        slab_free(ptr);
+    } else if (size >= MMAP_THRESHOLD && is_mapped(ptr)) {
+        stats.allocated_bytes -= get_size(location);
+        unmap_block(ptr);
+    } else {
+        stats.allocated_bytes -= get_size(location);
+        heap_free(ptr);
+    }
+    UNLOCK_HEAP();
+}
+
+/* Function: mymalloc_usable_size
+--------------------------
+Given a pointer to an allocated block, ptr, mymalloc_usable_size returns the number of bytes the caller can use at ptr.  This is the object size of its slab class for a slab object, and the payload size in its header for any other block, which includes the bytes added by rounding up to ALIGNMENT or MIN_BLOCK and any leftover bytes too few to split off.  It returns 0 if ptr is NULL.
+*/
+
+size_t mymalloc_usable_size(void *ptr) {
+    return (ptr == NULL) ? 0 : usable_size(ptr);
+}
+
+/* Function: mymalloc_batch
+--------------------------
+Given a number of bytes, size, a number of blocks, count, and an array, out, mymalloc_batch allocates count blocks of size bytes as mymalloc would and stores pointers to them in out, taking the heap lock once for all of them.  Small sizes are taken from slabs one object at a time.  Other sizes are carved from the heap in runs by heap_malloc_run, so a batch usually costs one free list search instead of count of them.  It returns the number of blocks allocated, and the entries of out after the last one are set to NULL.  In a THREAD_SAFE build, the blocks come from the shared heap rather than the calling thread's cache.
+*/
+
+size_t mymalloc_batch(size_t size, size_t count, void *out[]) {
+    size_t done = 0;
+    if (size != 0 && size <= MAX_REQUEST_SIZE) {
+        size_t needed = roundup((size < MIN_BLOCK) ? MIN_BLOCK : size, ALIGNMENT);
+        LOCK_HEAP();
+        if (size >= MMAP_THRESHOLD) {
+            while (done < count && (out[done] = map_block(needed)) != NULL) {
+                done++;
+            }
+        } else {
+            if (size <= MAX_SLAB_OBJECT) {
+                while (done < count && (out[done] = slab_malloc(slab_class(size))) != NULL) {
+                    done++;
+                }
+            }
+            // what the slabs could not hold comes from the heap
+            while (done < count) {
+                size_t carved = heap_malloc_run(needed, count - done, out + done);
+                if (carved == 0) {
+                    break;
+                }
+                done += carved;
+            }
+        }
+        for (size_t i = 0; i < done; i++) {
+            count_malloc(out[i]);
+        }
+        UNLOCK_HEAP();
+    }
+    for (size_t i = done; i < count; i++) {
+        out[i] = NULL;
+    }
+    return done;
+}
+
+/* Function: compare_pointers
+--------------------------
+Comparison function for qsort that orders pointers by address.
+*/
+
+int compare_pointers(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)*(void *const *)a;
+    uintptr_t y = (uintptr_t)*(void *const *)b;
+    return (x > y) - (x < y);
+}
+
+/* Function: myfree_batch
+--------------------------
+Given an array of pointers to allocated blocks, ptrs, and its length, count, myfree_batch frees every block in it, taking the heap lock once.  The pointers are sorted by address first, so blocks of the batch that are next to each other in the heap are found together and merged into one free block with a single call to coalesce, instead of being added to the free lists and taken off again one at a time.  Slab objects and blocks with a mapping of their own are freed one by one.  NULL entries are skipped, and ptrs is left sorted.  In a THREAD_SAFE build, the blocks go straight to the shared heap rather than to the calling thread's cache.
+*/
+
+void myfree_batch(void *ptrs[], size_t count) {
+    qsort(ptrs, count, sizeof(void *), compare_pointers);
+    size_t i = 0;
+    // NULL sorts before every block
+    while (i < count && ptrs[i] == NULL) {
+        i++;
+    }
+    LOCK_HEAP();
+    while (i < count) {
+        void *ptr = ptrs[i++];
+        count_free(ptr);
+        if (in_slab(ptr) || is_mapped(ptr)) {
+            release_block(ptr);
+            continue;
+        }
+        void *location = (char *)ptr - BLOCK_SIZE;
+        size_t space = get_size(location);
+        count_small(space, -1);
+        void *end_heap = (char *)segment_start + segment_size;  // a chunk after the first may start right here
+        // take in the blocks of the batch that directly follow this one
+        while (i < count && (char *)location + BLOCK_SIZE + space != end_heap &&
+               ptrs[i] == (char *)location + 2 * BLOCK_SIZE + space && !in_slab(ptrs[i])) {
+            count_free(ptrs[i]);
+            count_small(get_size((char *)ptrs[i] - BLOCK_SIZE), -1);
+            space += BLOCK_SIZE + get_size((char *)ptrs[i] - BLOCK_SIZE);
+            i++;
+        }
+        coalesce(location, space);
+    }
+    UNLOCK_HEAP();
+}
+
+/* Function: slab_realloc
+-----------------------------
+Given a pointer to an object in a slab, old_ptr, and a non-zero size, new_size, slab_realloc returns old_ptr if new_size still belongs to the object's slab class.  Otherwise it moves the object to a new object or block of new_size bytes and frees the old one, with mymalloc and myfree, which count the move.  If there is not enough space in the heap, slab_realloc does not free old_ptr and returns NULL.
+*/
+
+void *slab_realloc(void *old_ptr, size_t new_size) {
+    size_t old_size = get_slab(old_ptr)->object_size;
+    void *result = old_ptr;
+    if (new_size > old_size || slab_class(new_size) != slab_class(old_size)) {
+        result = mymalloc(new_size);
+        if (result == NULL) {
+            return NULL;
+        }
+        memcpy(result, old_ptr, (old_size < new_size) ? old_size : new_size);  // copy memory to new location
+        myfree(old_ptr);
+    }
+#ifdef THREAD_SAFE
+    // the object may never have been near the heap lock, so it is counted like a cached call
+    cache_discard_stale();
+    thread_cache.pending.reallocs++;
+#else
+    stats.reallocs++;
+#endif
+    return result;
+}
+
+/* Function: mycalloc
+-----------------------------
+Given a number of elements, nmemb, and the size of each, size, mycalloc returns a pointer to a block of nmemb * size bytes that are all zero, or NULL if the product is 0, too big or does not fit in the heap.  A block big enough for a mapping of its own is zero already.  Blocks of at most MAX_EXACT_SIZE bytes come from mymalloc, so they can be served from slabs and thread caches, and are cleared with memset.  Other blocks come from heap_calloc, which does not clear the parts of a free block that are known to be zero.
+*/
+
+void *mycalloc(size_t nmemb, size_t size) {
+    // if the product is 0 or too big to ever be satisfied
+    if (nmemb == 0 || size == 0 || nmemb > MAX_REQUEST_SIZE / size) {
+        return NULL;
+    }
+    size_t requested_size = nmemb * size;
+    if (requested_size <= MAX_EXACT_SIZE) {
+        void *result = mymalloc(requested_size);
+        if (result != NULL) {
+            memset(result, 0, requested_size);
+        }
+        return result;
+    }
+    LOCK_HEAP();
+    void *result = NULL;
+    // a new mapping is always zero
+    if (requested_size >= MMAP_THRESHOLD) {
+        result = map_block(roundup(requested_size, ALIGNMENT));
+    } else {
+        result = heap_calloc(roundup(requested_size, ALIGNMENT));
+    }
+    count_malloc(result);
+    UNLOCK_HEAP();
+    return result;
+}
+
+/* Function: myrealloc
+-----------------------------
+Given a pointer to the heap, old_ptr, and a size, new_size, myrealloc will change the old_ptr to point to the new_size amount of bytes and return old_ptr.  If there is not enough space at old_ptr for new_size amount of bytes, myrealloc will return a new pointer to a locaiton in the heap with new_size number of bytes and the memory from old_ptr copied.  myrealloc will then free the old memory used.  If there is not enough space in the heap for the request, myrealloc will not free old_ptr and return NULL.  If the inputted size is zero by realloc will free the meory pointed to by the inputted pointer.  If old_ptr is NULL, myrealloc will allocated new_size bytes of memory and will return the location of this memory on the heap.
+
+This function assumes that old_ptr points to the beggining of a previously allocated block of memory.
+*/
+
+void *myrealloc(void *old_ptr, size_t new_size) {
+    if (old_ptr == NULL) {
+        return mymalloc(new_size);
+    }
+    if (new_size == 0) {
+        myfree(old_ptr);
+        return NULL;
+    }
+    if (new_size > MAX_REQUEST_SIZE) {
+        return NULL;
+    }
+    if (in_slab(old_ptr)) {
+        return slab_realloc(old_ptr, new_size);
+    }
+    // if the requested size is less than MIN_BLOCK
+    if (new_size < MIN_BLOCK) {
+        new_size = MIN_BLOCK;
+    }
+    size_t needed = roundup(new_size, ALIGNMENT);  // align the new_size
+    LOCK_HEAP();
+    void *result = NULL;
+    size_t old_size = usable_size(old_ptr);
+    // if the block has or needs a mapping of its own
+    if (needed >= MMAP_THRESHOLD || is_mapped(old_ptr)) {
+        result = mapped_realloc(old_ptr, needed);
+    } else {
+        result = heap_realloc(old_ptr, needed);
+    }
+    if (result != NULL) {
+        stats.reallocs++;
+        stats.allocated_bytes += usable_size(result) - old_size;
+        // a block that moved was also allocated and freed
+        if (result != old_ptr) {
+            stats.mallocs++;
+            stats.frees++;
+        }
+    }
+    UNLOCK_HEAP();
+    return result;
+}
+
+/* Function: allocator_stats
+-----------------------------
+allocator_stats returns a copy of stats, taken under the heap lock.  The largest free block is the rightmost node of the tree if the tree is not empty.  Otherwise it is found from the highest non-empty bucket: an exact-size bucket holds blocks of one size, and for a power-of-two bucket, whose blocks are in no order, the largest size it can hold, or free_bytes if that is less, is reported as an upper bound.  In a THREAD_SAFE build, the calls other threads served from their caches since they last took the heap lock are not counted yet.
+*/
+
+allocator_stats_t allocator_stats() {
+    LOCK_HEAP();
+#ifdef THREAD_SAFE
+    cache_discard_stale();
+    cache_flush_stats();
+#endif
+    allocator_stats_t result = stats;
+    if (tree_root != NULL) {
+        tree_node *cur = tree_root;
+        while (cur->right != NULL) {
+            cur = cur->right;
+        }
+        result.largest_free = tree_size(cur);
+    } else if (nonempty_buckets != 0) {
+        int bucket = 63 - __builtin_clzl(nonempty_buckets);
+        if (bucket < NUM_EXACT_BUCKETS) {
+            result.largest_free = bucket * ALIGNMENT + MIN_BLOCK;
+        } else {
+            // the power-of-two bucket holds sizes up to the next power of two, and no block is bigger than all the free bytes
+            result.largest_free = (1UL << (bucket - NUM_EXACT_BUCKETS + EXACT_SIZE_LOG + 1)) - ALIGNMENT;
+            if (result.largest_free > result.free_bytes) {
+                result.largest_free = result.free_bytes;
+            }
+        }
+    } else {
+        result.largest_free = 0;
+    }
+    UNLOCK_HEAP();
+    return result;
+}
+
+/* Function: in_heap
+---------------------------------
+Given a pointer, ptr, in_heap returns true if ptr points into one of the chunks of the heap.
+*/
+
+bool in_heap(void *ptr) {
+    for (int chunk = 0; chunk < heap_segment_chunks(); chunk++) {
+        if (ptr >= get_chunk_start(chunk) && ptr < (void *)((char *)get_chunk_start(chunk) + get_chunk_size(chunk))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Function: check_tree
+---------------------------------
+Given a subtree of the tree of large free blocks, cur, the parent it should have, parent, a pointer to a count of tree nodes, count, and the most nodes there can be, limit, check_tree checks that every node of the subtree is a free block of at least TREE_MIN_SIZE bytes in the heap, that the subtree is ordered, that its parent links are right, and that no red node has a red child.  It adds the nodes of the subtree to the count, and returns the number of black nodes on every path down from cur, or -1 if a check fails or two paths have a different number of black nodes.  The walk stops early if the count passes limit, so a loop in the tree can not run forever.
+*/
+
+int check_tree(tree_node *cur, tree_node *parent, size_t *count, size_t limit) {
+    if (cur == NULL) {
+        return 1;
+    }
+    void *cur_header = (char *)cur - BLOCK_SIZE;
+    if (!in_heap(cur_header) || !is_free(cur_header) || tree_size(cur) < TREE_MIN_SIZE || cur->parent != parent) {
+        return -1;
+    }
+    if ((cur->left != NULL && !tree_less(cur->left, cur)) || (cur->right != NULL && !tree_less(cur, cur->right))) {
+        return -1;
+    }
+    if (cur->red && ((cur->left != NULL && cur->left->red) || (cur->right != NULL && cur->right->red))) {
+        return -1;
+    }
+    if (++*count > limit) {
+        return -1;
+    }
+    int left_height = check_tree(cur->left, cur, count, limit);
+    int right_height = check_tree(cur->right, cur, count, limit);
+    if (left_height < 0 || left_height != right_height) {
+        return -1;
+    }
+    return left_height + (cur->red ? 0 : 1);
+}
+
+/* Function: check_slab
+---------------------------------
+Given a slab, cur, check_slab returns true if its object size is a slab class, its object count matches that size, and its count of free objects matches the bits set in its bitmap, and false otherwise.
+*/
+
+bool check_slab(slab *cur) {
+    if (cur->object_size == 0 || cur->object_size > MAX_SLAB_OBJECT || cur->object_size % ALIGNMENT != 0) {
+        return false;
+    }
+    if (cur->nobjects != (SLAB_SIZE - SLAB_HEADER) / cur->object_size) {
+        return false;
+    }
+    int nfree = 0;
+    for (int word = 0; word < SLAB_BITMAP_WORDS; word++) {
+        nfree += __builtin_popcountl(cur->free_map[word]);
+    }
+    // no bit past the last object may be set
+    for (int i = cur->nobjects; i < SLAB_BITMAP_WORDS * 64; i++) {
+        if ((cur->free_map[i / 64] >> (i % 64)) & 1) {
+            return false;
+        }
+    }
+    return nfree == cur->nfree;
+}
+
+/* Function: check_heap
+---------------------------------
+This function checks the internal structure of the heap by ensuring that all the memory of every chunk of the heap is accounted for, that every added chunk ends in a correct epilogue, that every region holds exactly one block with a mapping of its own, and that the free lists contain exactly the free blocks of the heap.  Every free block must have a footer matching its header and no free block may follow another, and each header must record correctly whether the block before it is free.  Every node on a list must belong to a free block in the heap that is filed in the right bucket, with a prev pointer that matches the list, and a bucket is marked non-empty exactly when its list has nodes.  The tree of large free blocks must be a correct red-black tree of free blocks.  Every page marked in slab_pages must be the payload of a used block holding a correct slab, the partial slab lists must hold exactly the slabs with a free object, and small_live must match the small used blocks and slab objects.  If there is memory that is not accounted for, a free block that is not on a list, or a node on a list that does not correspond to a correct free block, check_heap returns false, otherwise if returns true.  In a THREAD_SAFE build, the caller must hold the heap lock.
+*/
+
+bool check_heap() {
+    size_t free_blocks = 0;  // create a variable to count free blocks in the heap
+    size_t free_bytes = 0;  // create a variable to add up the payload bytes of the free blocks
+    size_t slabs = 0;  // create a variable to count slabs in the heap
+    size_t partial = 0;  // create a variable to count slabs with a free object
+    size_t live[NUM_SLAB_CLASSES] = {0};  // used heap blocks and slab objects counted the way count_small does
+    for (int chunk = 0; chunk < heap_segment_chunks(); chunk++) {
+        void *temp = get_chunk_start(chunk);  // create a pointer to traverse headers of list
+        size_t count = 0;  // create a variable to count accounted for bytes
+        // every chunk but the first ends in an epilogue that is not a block
+        void *end_heap = (char *)get_chunk_start(chunk) + get_chunk_size(chunk) - ((chunk == 0) ? 0 : BLOCK_SIZE);
+        bool last_free = false;  // create a variable to remember if the previous block was free
+        // while there are headers to be read
+        while (temp < end_heap) {
+            size_t block_size = get_size(temp) + BLOCK_SIZE;
+            if (block_size < BLOCK_SIZE + MIN_BLOCK || prev_is_free(temp) != last_free ||
+                (((header *)temp)->size & MAPPED_BIT) != 0) {
+                return false;
+            }
+            last_free = is_free(temp);
+            // if the header is free
+            if (last_free) {
+                // a free block next to another one should have been coalesced, and its footer must match
+                if (prev_is_free(temp) || ((footer *)((char *)temp + get_size(temp)))->size != get_size(temp)) {
+                    return false;
+                }
+                free_blocks++;
+                free_bytes += get_size(temp);
+                // if the used block holds a slab
+            } else if (in_slab((char *)temp + BLOCK_SIZE)) {
+                slab *cur = (slab *)((char *)temp + BLOCK_SIZE);
+                if (cur != get_slab(cur) || get_size(temp) < SLAB_SIZE || !check_slab(cur)) {
+                    return false;
+                }
+                slabs++;
+                if (cur->nfree > 0) {
+                    partial++;
+                }
+                size_t object_size = (cur->object_size < MIN_BLOCK) ? MIN_BLOCK : cur->object_size;
+                live[slab_class(object_size)] += cur->nobjects - cur->nfree;
+            } else if (get_size(temp) <= MAX_SLAB_OBJECT) {
+                live[slab_class(get_size(temp))]++;
+            }
+            count += block_size;  // update the amount to account for the bytes of the block
+            temp = (char *)temp + block_size;  // point temp to next header
+        }
+        //  checks if memory used by the blocks equals the memory of the chunk
+        if (count != (size_t)((char *)end_heap - (char *)get_chunk_start(chunk))) {
+            return false;
+        }
+        // the epilogue must be a used header with no payload that knows if the last block is free
+        if (chunk > 0 && (get_size(end_heap) != 0 || is_free(end_heap) || prev_is_free(end_heap) != last_free)) {
+            return false;
+        }
+    }
+    // every marked page was found
+    if (slabs != num_slabs) {
+        return false;
+    }
+    // every region holds one used block with a mapping of its own, big enough to need one
+    size_t mapped = 0;
+    for (void *region = heap_region_next(NULL); region != NULL; region = heap_region_next(region)) {
+        header *headerptr = (header *)region;
+        if ((headerptr->size & (USED_BIT | MAPPED_BIT | PREV_FREE_BIT)) != (USED_BIT | MAPPED_BIT) ||
+            get_size(headerptr) < MMAP_THRESHOLD || BLOCK_SIZE + get_size(headerptr) > heap_region_size(region)) {
+            return false;
+        }
+        if (++mapped > num_mapped) {
+            return false;
+        }
+    }
+    if (mapped != num_mapped) {
+        return false;
+    }
+    // the counters kept by make_free and remove_free, and by count_small, must match the heap
+    if (stats.free_blocks != free_blocks || stats.free_bytes != free_bytes ||
+        memcmp(live, small_live, sizeof(live)) != 0) {
+        return false;
+    }
+    // every partial slab must be on the list of its class
+    for (int class = 0; class < NUM_SLAB_CLASSES; class++) {
+        slab *prev_slab = NULL;
+        for (slab *cur = partial_slabs[class]; cur != NULL; cur = cur->next) {
+            if (!in_slab(cur) || slab_class(cur->object_size) != class || cur->nfree == 0 || cur->prev != prev_slab) {
+                return false;
+            }
+            if (partial-- == 0) {
+                return false;
+            }
+            prev_slab = cur;
+        }
+    }
+    if (partial != 0) {
+        return false;
+    }
+    size_t listed_blocks = 0;  // create a variable to count nodes on the free lists
+    for (int bucket = 0; bucket < NUM_BUCKETS; bucket++) {
+        bool marked = (nonempty_buckets >> bucket) & 1;
+        if (marked != (buckets[bucket] != NULL)) {
+            return false;
+        }
+        node *prev_node = NULL;
+        // walk the list, stopping early if it has more nodes than free blocks exist
+        for (node *cur_node = buckets[bucket]; cur_node != NULL; cur_node = cur_node->next) {
+            void *cur_header = (char *)cur_node - BLOCK_SIZE;
+            if (!in_heap(cur_header) || !is_free(cur_header)) {
+                return false;
+            }
+            if (get_bucket(get_size(cur_header)) != bucket || cur_node->prev != prev_node) {
+                return false;
+            }
+            if (++listed_blocks > free_blocks) {
+                return false;
+            }
+            prev_node = cur_node;
+        }
+    }
+    if (tree_root != NULL && (tree_root->red || check_tree(tree_root, NULL, &listed_blocks, free_blocks) < 0)) {
+        return false;
+    }
+    // every free block of the heap must be on exactly one list or in the tree
+    return (listed_blocks == free_blocks);
+}
+
+/* Function: validate_heap
+---------------------------------
+This function checks the internal structure of the heap using check_heap, and returns false if there were issues, or true otherwise.  Blocks held in thread caches are still marked used in the heap, so they are checked like any other used block.
+*/
+
+bool validate_heap() {
+    LOCK_HEAP();
+    bool valid = check_heap();
+    UNLOCK_HEAP();
+    return valid;
+}
+
+/* Function: dump_tree
+ * -------------------
+ * Prints the nodes of the subtree cur in order, with the size of each block
+ * and whether the node is red or black.
+ */
+void dump_tree(tree_node *cur) {
+    if (cur == NULL) {
+        return;
+    }
+    dump_tree(cur->left);
+    printf(" %p (%zu, %c)", cur, tree_size(cur), cur->red ? 'r' : 'b');
+    dump_tree(cur->right);
+}
+
+/* Function: dump_heap
+ * -------------------
+ * This function prints out the the block contents of the heap.  For all headers in each chunk, this function prints out the pointer to the header, a character indicating that it is free, used, or a slab, the size of the block, and the amount of bytes in hex until the next header.  If the header is free, dump_heap also prints out the current node, the next node, and the previous node in the free linked list, and for a slab it prints the object size and how many objects are free.  After the blocks, it prints the blocks with a mapping of their own, every non-empty bucket and the nodes on its list, and then the nodes of the tree in order.  dump_heap is not
+ * called anywhere, but is a useful helper function to call from gdb when
+ * tracing through programs.  It prints out the total range of the heap, and
  * information about each block within it.
  */
 void dump_heap() {
-    void *temp = segment_start;
-    void *end_heap = (char *)segment_start + segment_size;
-    printf("%s: %p\n", "pointer to first free header", first_free);  // print out pointer to first free block
-    // while there are headers in the heap
-    while (temp < end_heap) {
-        if (is_free(temp)) {
-            printf("%p, %c, %ld, %zx, ", temp, 'f', ((header *)temp)->size, ((header *)temp)->size + BLOCK_SIZE);
-            node *cur_node = (node *)((char *)temp + BLOCK_SIZE);
-            printf("%p, %p, %p\n", cur_node, cur_node->next, cur_node->prev);
-            temp = (char *)temp + BLOCK_SIZE + ((header *)temp)->size;
-        } else {
-            size_t block_len = (((header *)temp)->size) - 1;
-            printf("%p, %c, %ld, %zx\n", temp, 'u', block_len, block_len + BLOCK_SIZE);
+    for (int chunk = 0; chunk < heap_segment_chunks(); chunk++) {
+        void *temp = get_chunk_start(chunk);
+        void *end_heap = (char *)get_chunk_start(chunk) + get_chunk_size(chunk) - ((chunk == 0) ? 0 : BLOCK_SIZE);
+        printf("Heap chunk %d starts at address %p, ends at %p\n", chunk, get_chunk_start(chunk), end_heap);
+        // while there are headers in the chunk
+        while (temp < end_heap) {
+            size_t block_len = get_size(temp);
+            if (is_free(temp)) {
+                printf("%p, %c, %ld, %zx, ", temp, 'f', block_len, block_len + BLOCK_SIZE);
+                node *cur_node = (node *)((char *)temp + BLOCK_SIZE);
+                printf("%p, %p, %p\n", cur_node, cur_node->next, cur_node->prev);
+            } else if (in_slab((char *)temp + BLOCK_SIZE)) {
+                slab *cur = (slab *)((char *)temp + BLOCK_SIZE);
+                printf("%p, %c, %ld, %zx, slab of %d-byte objects, %d/%d free\n", temp, 's', block_len,
+                       block_len + BLOCK_SIZE, cur->object_size, cur->nfree, cur->nobjects);
+            } else {
+                printf("%p, %c, %ld, %zx\n", temp, 'u', block_len, block_len + BLOCK_SIZE);
+            }
             temp = (char *)temp + BLOCK_SIZE + block_len;
         }
     }
+    // print the blocks with a mapping of their own
+    for (void *region = heap_region_next(NULL); region != NULL; region = heap_region_next(region)) {
+        printf("%p, %c, %ld, mapped\n", region, 'm', get_size(region));
+    }
+    // print the nodes of each non-empty bucket
+    for (int bucket = 0; bucket < NUM_BUCKETS; bucket++) {
+        if (buckets[bucket] == NULL) {
+            continue;
+        }
+        printf("bucket %d:", bucket);
+        for (node *cur_node = buckets[bucket]; cur_node != NULL; cur_node = cur_node->next) {
+            printf(" %p", cur_node);
+        }
+        printf("\n");
+    }
+    if (tree_root != NULL) {
+        printf("tree:");
+        dump_tree(tree_root);
+        printf("\n");
+    }
 }
@@ -2,6 +2,8 @@
 Code written by: Christo Hristov
 
 This file contains a series of utility functions implemented to allocate, free, and reallocate memory from a heap.  These functions are used in the test_implicit.c file.
+
+When compiled with NEXT_FIT defined, the allocator keeps a roving pointer to where the last search ended and starts the next search there instead of at the start of the heap.  myfree also merges the freed block with free neighbours right away.  To find the block before in constant time, each free block ends in a footer holding its size, and a bit in each header records whether the block before it is free.  Used blocks still only have a header.
 */
 #include <stdio.h>
 #include <string.h>
@@ -9,8 +11,16 @@ This file contains a series of utility functions implemented to allocate, free,
 #include "./debug_break.h"
 
 #define HEADER_SIZE 8  // define a constant to hold the number of bytes in a header
+#define USED_BIT 1  // bit of the header that is set when the block is used
+#define PREV_FREE_BIT 2  // bit of the header that is set when the block before is free (NEXT_FIT only)
+#define SIZE_MASK ~(size_t)(ALIGNMENT - 1)  // the bits of the header that hold the size
 static void *segment_start;
 static size_t segment_size;
+static allocator_stats_t stats;  // counters returned by allocator_stats, largest_free is filled in when asked
+static size_t free_classes[64];  // number of free blocks whose size has each highest set bit
+#ifdef NEXT_FIT
+static void *rover;  // header of the block where the next search starts
+#endif
 
 // create a struct, header, to hold the size the block of memory indicated by the header
 typedef struct {
@@ -43,6 +53,60 @@ bool is_free(void *headerptr) {
     }
 }
 
+/* Function: get_size
+---------------------------
+Given a void pointer to a header, headerptr, get_size returns the size of the block without the bits that mark it used or that mark the block before it free.
+*/
+
+size_t get_size(void *headerptr) {
+    return ((header *)headerptr)->size & SIZE_MASK;
+}
+
+/* Function: next_header
+---------------------------
+Given a void pointer to a header, headerptr, next_header returns a pointer to the header of the block after it.  This is the end of the heap if headerptr is the last block.
+*/
+
+void *next_header(void *headerptr) {
+    return (char *)headerptr + HEADER_SIZE + get_size(headerptr);
+}
+
+#ifdef NEXT_FIT
+/* Function: set_prev_free
+---------------------------
+Given a void pointer to a header, headerptr, and whether the block before it is free, prev_free, set_prev_free updates the bit of that header which records if the block before is free.  Nothing is changed if headerptr is the end of the heap.
+*/
+
+void set_prev_free(void *headerptr, bool prev_free) {
+    if (headerptr >= (void *)((char *)segment_start + segment_size)) {
+        return;
+    }
+    header *header_ptr = (header *)headerptr;
+    if (prev_free) {
+        header_ptr->size |= PREV_FREE_BIT;
+    } else {
+        header_ptr->size &= ~(size_t)PREV_FREE_BIT;
+    }
+}
+#endif
+
+/* Functions: stats_add_free, stats_remove_free
+-----------------------------
+Given the payload size of a block, space, stats_add_free counts it as a free block in stats and in free_classes, and stats_remove_free stops counting it.  Every free block is counted from when it is made until it is used or merged away.
+*/
+
+void stats_add_free(size_t space) {
+    stats.free_blocks++;
+    stats.free_bytes += space;
+    free_classes[63 - __builtin_clzl(space)]++;
+}
+
+void stats_remove_free(size_t space) {
+    stats.free_blocks--;
+    stats.free_bytes -= space;
+    free_classes[63 - __builtin_clzl(space)]--;
+}
+
 /* Function: make_used
 -----------------------------
 Given a void pointer, headerptr, and a requested size, requested_size, make_used will change the header pointed to by headerptr to indicate a used block in memory with requested_size bytes.
@@ -52,19 +116,144 @@ This function assumes that headerptr points to a header in the heap.
 
 void make_used(void *headerptr, size_t requested_size) {
     header *header_ptr = (header *)headerptr;
+#ifdef NEXT_FIT
+    // keep the bit for the block before, and tell the block after that this one is used
+    header_ptr->size = (requested_size + USED_BIT) | (header_ptr->size & PREV_FREE_BIT);
+    set_prev_free(next_header(headerptr), false);
+#else
     header_ptr->size = requested_size + 1;  // add one to the end to indicate used block
+#endif
 }
 
 /* Function: make_free
 -----------------------------
-Given a void pointer, headerptr, and a requested size, space, make_free will change the header pointed to by headerptr to indicate a free block in memory with space bytes.
+Given a void pointer, headerptr, and a requested size, space, make_free will change the header pointed to by headerptr to indicate a free block in memory with space bytes.  With NEXT_FIT, it also writes the footer of the block and tells the block after that this one is free.
 
-This function assumes that headerptr points to a header in the heap and that space is an alligned amount.
+This function assumes that headerptr points to a header in the heap, that space is an alligned amount of at least HEADER_SIZE, and that the block before is used.
 */
 
 void make_free(void *ptr, size_t space) {
     header *header_ptr = (header *)ptr;
     header_ptr->size = space;
+#ifdef NEXT_FIT
+    header *footer_ptr = (header *)((char *)ptr + space);  // the footer is the last eight bytes of the block
+    footer_ptr->size = space;
+    set_prev_free(next_header(ptr), true);
+#endif
+}
+
+#ifdef NEXT_FIT
+/* Function: coalesce
+-----------------------------
+Given a void pointer to the header of a block that was just freed, headerptr, coalesce merges it with the free block after it and the free block before it, if there are any, and returns the header of the merged free block.  If the roving pointer was at a block that was merged away, it is moved to the merged block.
+
+This function assumes that headerptr points to a header in the heap with its used bit cleared.
+*/
+
+void *coalesce(void *headerptr) {
+    size_t space = get_size(headerptr);
+    void *next = next_header(headerptr);
+    // merge the block after, if it is free
+    if (next < (void *)((char *)segment_start + segment_size) && is_free(next)) {
+        stats_remove_free(get_size(next));
+        space += HEADER_SIZE + get_size(next);
+    }
+    // merge the block before, found through its footer, if it is free
+    if ((((header *)headerptr)->size & PREV_FREE_BIT) != 0) {
+        size_t prev_space = ((header *)((char *)headerptr - HEADER_SIZE))->size;
+        stats_remove_free(prev_space);
+        headerptr = (char *)headerptr - HEADER_SIZE - prev_space;
+        space += HEADER_SIZE + prev_space;
+    }
+    make_free(headerptr, space);
+    stats_add_free(space);
+    if (rover > headerptr && rover < (void *)((char *)headerptr + HEADER_SIZE + space)) {
+        rover = headerptr;
+    }
+    return headerptr;
+}
+#endif
+
+/* Function: scan_fit
+-----------------------------
+Given pointers to the headers where a search begins, from, and ends, to, an alligned number of bytes, needed, and a pointer, last_free, scan_fit returns the header of the first free block from from up to to with at least needed bytes, or NULL if there is none.  If last_free is not NULL, the last block of the heap is skipped, and if it is free its header is stored in last_free.
+*/
+
+void *scan_fit(void *from, void *to, size_t needed, void **last_free) {
+    void *end_heap = (char *)segment_start + segment_size;
+    void *temp = from;  // create a temporary pointer to traverse the heap
+    // while there are still headers left to check
+    while (temp < to) {
+        stats.search_steps++;
+        void *next = next_header(temp);
+        // if the header pointed to by temp is free and has enough space to service the request
+        if (is_free(temp) && needed <= get_size(temp)) {
+            if (last_free == NULL || next < end_heap) {
+                return temp;
+            }
+            *last_free = temp;
+        }
+        temp = next;  // point temp to next header
+    }
+    return NULL;
+}
+
+/* Function: find_fit
+-----------------------------
+Given an alligned number of bytes, needed, find_fit returns the header of a free block with at least needed bytes, or NULL if there is none.  The search starts at the start of the heap, or with NEXT_FIT at the roving pointer, wrapping around to the start of the heap when it reaches the end.  With NEXT_FIT, a free block at the end of the heap is only used when no other block fits.  Otherwise the roving pointer would keep carving new blocks off the untouched end of the heap instead of reusing freed ones, and the heap would grow far past what is needed.
+*/
+
+void *find_fit(size_t needed) {
+    void *end_heap = (char *)segment_start + segment_size;  // intialize a pointer to the end of the heap
+#ifdef NEXT_FIT
+    void *last_free = NULL;  // the free block at the end of the heap, if it fits
+    void *found = scan_fit(rover, end_heap, needed, &last_free);
+    if (found == NULL) {
+        found = scan_fit(segment_start, rover, needed, &last_free);
+    }
+    if (found == NULL) {
+        found = last_free;
+    }
+    return found;
+#else
+    return scan_fit(segment_start, end_heap, needed, NULL);
+#endif
+}
+
+/* Function: place
+-----------------------------
+Given a pointer to the header of a free block, temp, and an alligned number of bytes, needed, place makes the start of the block a used block with needed bytes and returns a pointer to its payload.  Every block handed out is placed here, so this is where mallocs are counted.  The rest of the block is made into a new free block, unless it would only have room for a header.  With NEXT_FIT, the roving pointer moves to the block after the used block.
+
+This function assumes that temp is a free block with at least needed bytes.
+*/
+
+void *place(void *temp, size_t needed) {
+    void *result = (char *)temp + HEADER_SIZE;  // create pointer to the place in the heap we will give to caller
+    // calculate excess space in block considering that we do not want to leave space just for a header
+    long space = get_size(temp) - (needed + HEADER_SIZE);
+    stats_remove_free(get_size(temp));
+    // if free block contains enough memory for the allocated block and a header
+    if (space == 0) {
+        make_used(temp, needed + HEADER_SIZE);  // make the whole free block used
+        // if free block contains more memory than that needed for alocated block and a header
+    } else if (space >= 0) {
+        make_used(temp, needed);  // allocate a block to the user
+        make_free((char *)temp + HEADER_SIZE + needed, space);  // make the rest of the block free
+        stats_add_free(space);
+        // if free block contains exactly enough memory for the allocated block
+    } else {
+        make_used(temp, needed);  // make entire block used
+    }
+    stats.mallocs++;
+    stats.allocated_bytes += get_size(temp);
+#ifdef NEXT_FIT
+    rover = next_header(temp);
+    // wrap around to the start when the used block is the last one
+    if (rover >= (void *)((char *)segment_start + segment_size)) {
+        rover = segment_start;
+    }
+#endif
+    return result;
 }
 
 /* Function: myinit
@@ -83,6 +272,13 @@ bool myinit(void *heap_start, size_t heap_size) {
     segment_size = heap_size;
     header *first_header = (header *)heap_start;
     first_header->size = heap_size - HEADER_SIZE;  // intializing a header that indicates the whole heap is free to use
+    memset(&stats, 0, sizeof(stats));
+    memset(free_classes, 0, sizeof(free_classes));
+    stats_add_free(heap_size - HEADER_SIZE);
+#ifdef NEXT_FIT
+    make_free(first_header, heap_size - HEADER_SIZE);
+    rover = segment_start;
+#endif
     return true;
 }
 
@@ -98,48 +294,69 @@ void *mymalloc(size_t requested_size) {
         return result;
     }
     size_t needed = roundup(requested_size, ALIGNMENT);  // calcuate the alligned number of bytes needed
-    void *temp = segment_start;  // create a temporary pointer to traverse the heap
-    void *end_heap =  (char *)segment_start + segment_size;  // intialize a pointer to the end of the heap
-    // while there are still headers left to check
-    while (temp < end_heap) {
-        // if the header pointed to by temp is free
-        if (is_free(temp)) {
-            // if there is enough space in the free block to service the request
-            if (needed <= ((header *)temp)->size) {
-                // calculate excess space in block considering that we do not want to leave space just for a header
-                long space = ((header *)temp)->size - (needed + HEADER_SIZE);
-                result = (char *)temp + HEADER_SIZE;  // create pointer to the place in the heap we will give to caller
-                // if free block contains enough memory for the allocated block and a header
-                if (space == 0) {
-                    make_used(temp, needed + HEADER_SIZE);  // make the whole free block used
-                    return result;
-                    // if free block contains more memory than that needed for alocated block and a header
-                } else if (space >= 0) {
-                    make_used(temp, needed);  // allocate a block to the user
-                    temp = (char *)temp + HEADER_SIZE + needed;  // update temp to point to rest of memory in free block
-                    make_free(temp, space);  // make the rest of the block free
-                    return result;
-                    // if free block contains exactly enough memory for the allocated block
-                } else {
-                    make_used(temp, needed);  // make entire block used
-                    return result;
-                }
-                // if free block does not have enough space for the user request
-            } else {
-                temp = (char *)temp + HEADER_SIZE + ((header *)temp)->size;  // point temp to next header
-            }
-            // if header indicates the block is used
-        } else {
-            temp = (char *)temp + HEADER_SIZE + (((header *)temp)->size - 1);  // point temp to next header
-        }
+    void *temp = find_fit(needed);
+    // if no block is found, the heap was exhausted, and we return NULL
+    if (temp != NULL) {
+        result = place(temp, needed);
+    }
+    return result;
+}
+
+/* Function: mycalloc
+------------------------------------
+Given a number of elements, nmemb, and the size of each, size, mycalloc returns a pointer to a block of nmemb * size bytes that are all zero, or NULL if the product is 0, too big or does not fit in the heap.  Free blocks do not record whether they are zero, so the block is cleared with memset.
+*/
+
+void *mycalloc(size_t nmemb, size_t size) {
+    if (nmemb == 0 || size == 0 || nmemb > MAX_REQUEST_SIZE / size) {
+        return NULL;
+    }
+    void *result = mymalloc(nmemb * size);
+    if (result != NULL) {
+        memset(result, 0, nmemb * size);
     }
-    // if result is not updated, the heap was exhausted, and we return NULL
     return result;
 }
 
+/* Function: mymemalign
+------------------------------------
+Given a power of two, alignment, and a number of bytes, requested_size, mymemalign returns a pointer to a block of requested_size bytes that starts at a multiple of alignment.  It takes a free block big enough to hold the payload after any gap needed to reach the alignment, and the gap becomes a free block of its own instead of being wasted.  A gap must have room for a header and a payload of at least HEADER_SIZE bytes, so the payload moves up by another alignment when the gap would be smaller.  Alignments of at most ALIGNMENT are met by every block, so those requests are passed to mymalloc.  mymemalign returns NULL if requested_size is 0, alignment is not a power of two, or there is not enough free memory.
+*/
+
+void *mymemalign(size_t alignment, size_t requested_size) {
+    if (requested_size == 0 || alignment > MAX_REQUEST_SIZE || (alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+    if (alignment <= ALIGNMENT) {
+        return mymalloc(requested_size);
+    }
+    size_t needed = roundup(requested_size, ALIGNMENT);
+    // a block this big can always fit the payload after a gap big enough to be a free block
+    void *temp = find_fit(needed + alignment + 2 * HEADER_SIZE);
+    if (temp == NULL) {
+        return NULL;
+    }
+    char *payload = (char *)temp + HEADER_SIZE;
+    char *aligned = (char *)roundup((size_t)payload, alignment);
+    if (aligned != payload && aligned - payload < 2 * HEADER_SIZE) {
+        aligned += alignment;
+    }
+    if (aligned != payload) {
+        // the rest of the block after the gap gets its header first, so make_free can mark it
+        size_t rest = get_size(temp) - (aligned - payload);
+        stats_remove_free(get_size(temp));
+        ((header *)(aligned - HEADER_SIZE))->size = rest;
+        make_free(temp, aligned - payload - HEADER_SIZE);
+        stats_add_free(aligned - payload - HEADER_SIZE);
+        stats_add_free(rest);
+        temp = aligned - HEADER_SIZE;
+    }
+    return place(temp, needed);
+}
+
 /* Function: myfree
 -----------------------------
-Given a pointer to the heap, myfree will free the memory pointed to by the pointer so that it can be allocated again.  myfree will do nothing if given a NULL pointer.
+Given a pointer to the heap, myfree will free the memory pointed to by the pointer so that it can be allocated again.  With NEXT_FIT, the freed block is merged with free blocks next to it.  myfree will do nothing if given a NULL pointer.
 */
 
 void myfree(void *ptr) {
@@ -149,6 +366,13 @@ void myfree(void *ptr) {
     void *temp = (char *)ptr - HEADER_SIZE;  // create a pointer to the header of the inputted memory
     header *headerptr = (header *)temp;  
     (headerptr->size)--;  // make the header indicate free memory instead of used memory
+    stats.frees++;
+    stats.allocated_bytes -= get_size(temp);
+#ifdef NEXT_FIT
+    coalesce(temp);
+#else
+    stats_add_free(get_size(temp));
+#endif
 }
 
 /* Function: myrealloc
@@ -166,79 +390,146 @@ void *myrealloc(void *old_ptr, size_t new_size) {
     }
     void *result = NULL;
     size_t needed = roundup(new_size, ALIGNMENT);  // align the inputed size with ALIGNMENT constant
-    void *temp = segment_start;  // create a temporary pointer to traverse the heap
-    void *end_heap =  (char *)segment_start + segment_size;  // create a pointer to the end of the heap
-    // while there are headers to check
-    while (temp < end_heap) {
-        // if the header indicates free block of memory
-        if (is_free(temp)) {
-            // if the free block has enough memory to accomodate the realloc request
-            if (needed <= ((header *)temp)->size) {
-                // calculate excess space in block considering that we do not want to leave space just for a header
-                long space = ((header *)temp)->size - (needed + HEADER_SIZE); 
-                result = (char *)temp + HEADER_SIZE;  // update result to hold the place in heap we want to return
-                void *old_header = (char *)old_ptr - 8;  // pointer to the header of the old block of memory
-                size_t old_size = ((header *)old_header)->size;  // size of old block of memory
-                size_t copy_size = 0;  // create a variable to hold how many bytes we want to copy to new block
-                // if we are reallocating to smaller block 
-                if (old_size >= new_size) {
-                    copy_size = new_size;  // only new block amount of memory from old block
-                    // if we are reallocating to bigger block
-                } else {
-                    copy_size = old_size;  // copy old block amount of memory to new block
-                }
-                memmove(result, old_ptr, copy_size);
-                (((header *)old_header)->size)--;  // make old block free
-                // if free block contains enough memory for the allocated block and a header
-                if (space == 0) {
-                    make_used(temp, needed + HEADER_SIZE);
-                    return result;
-                    // if there is more that the needed space in the free block
-                } else if (space >= 0) {
-                    make_used(temp, needed);
-                    temp = (char *)temp + HEADER_SIZE + needed;
-                    make_free(temp, space);  // free the remaining block in the free block by creating free header
-                    return result;
-                    // if there is exactly enough space in free block to accomadate just the requested size w/o header
-                } else {
-                    make_used(temp, needed);
-                    return result;
-                }
-                // if free block does not have enough memory
-            } else {
-                temp = (char *)temp + HEADER_SIZE + ((header *)temp)->size;  // update temp to point to next header
-            }
-            // if block is used
-        } else {
-            temp = (char *)temp + HEADER_SIZE + (((header *)temp)->size - 1);  // update temp to point to next header
+    void *temp = find_fit(needed);
+    // if the heap was exhausted, result will still equal NULL
+    if (temp == NULL) {
+        return result;
+    }
+    void *old_header = (char *)old_ptr - HEADER_SIZE;  // pointer to the header of the old block of memory
+    size_t old_size = get_size(old_header);  // size of old block of memory
+    size_t copy_size = 0;  // create a variable to hold how many bytes we want to copy to new block
+    // if we are reallocating to smaller block 
+    if (old_size >= new_size) {
+        copy_size = new_size;  // only new block amount of memory from old block
+        // if we are reallocating to bigger block
+    } else {
+        copy_size = old_size;  // copy old block amount of memory to new block
+    }
+    // place the new block before freeing the old one, so the free block can not merge with the old block first
+    result = place(temp, needed);
+    memcpy(result, old_ptr, copy_size);
+    myfree(old_ptr);
+    stats.reallocs++;
+    return result;
+}
+
+/* Function: myfree_sized
+-----------------------------
+Given a pointer to the heap, ptr, and the size it was requested with, size, myfree_sized frees the block like myfree.  Freeing a block only changes the bit in its header, so the size is not needed.
+*/
+
+void myfree_sized(void *ptr, size_t size) {
+    myfree(ptr);
+}
+
+/* Function: mymalloc_usable_size
+-----------------------------
+Given a pointer to an allocated block, ptr, mymalloc_usable_size returns the number of bytes the caller can use at ptr, which is the payload size in its header.  It can be more than was requested, because sizes are rounded up to ALIGNMENT and leftover space too small to split off stays in the block.  It returns 0 if ptr is NULL.
+*/
+
+size_t mymalloc_usable_size(void *ptr) {
+    if (ptr == NULL) {
+        return 0;
+    }
+    return get_size((char *)ptr - HEADER_SIZE);
+}
+
+/* Function: mymalloc_batch
+------------------------------------
+Given a number of bytes, size, a number of blocks, count, and an array, out, mymalloc_batch allocates count blocks of size bytes and stores pointers to them in out.  The implicit list has no cheaper way to place several blocks than one search each, so each block is allocated with mymalloc.  It returns the number of blocks allocated, and the entries of out after the last one are set to NULL.
+*/
+
+size_t mymalloc_batch(size_t size, size_t count, void *out[]) {
+    size_t done = 0;
+    while (done < count && (out[done] = mymalloc(size)) != NULL) {
+        done++;
+    }
+    for (size_t i = done; i < count; i++) {
+        out[i] = NULL;
+    }
+    return done;
+}
+
+/* Function: myfree_batch
+------------------------------------
+Given an array of pointers to the heap, ptrs, and its length, count, myfree_batch frees every block in ptrs with myfree.  NULL entries are skipped.
+*/
+
+void myfree_batch(void *ptrs[], size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        myfree(ptrs[i]);
+    }
+}
+
+/* Function: allocator_stats
+-------------------------------
+allocator_stats returns a copy of stats.  Free blocks are not indexed by size, only counted in free_classes by their highest set bit, so the largest size of the highest class that has a block is reported as an upper bound on the largest free block, instead of walking the heap to find it.  The bound is never more than free_bytes.
+*/
+
+allocator_stats_t allocator_stats() {
+    allocator_stats_t result = stats;
+    result.largest_free = 0;
+    for (int class = 63; class >= 0; class--) {
+        if (free_classes[class] > 0) {
+            result.largest_free = (class == 63) ? SIZE_MASK : (1UL << (class + 1)) - ALIGNMENT;
+            break;
         }
     }
-    // if the heap was exhausted, result will still equal NULL
+    // no free block is bigger than all the free bytes together
+    if (result.largest_free > result.free_bytes) {
+        result.largest_free = result.free_bytes;
+    }
     return result;
 }
 
 /* Function: validate_heap
 -------------------------------
-This function checks the internal structure of the heap by ensuring that all the memory of the heap is accounted for.  That is, all blocks are either allocated or freed.  If there is memory that is not accounted for, validate_heap returns false, and otherwise it returns true.
+This function checks the internal structure of the heap by ensuring that all the memory of the heap is accounted for.  That is, all blocks are either allocated or freed.  The free blocks found must also match the counts kept in stats.  With NEXT_FIT, it also checks that no two free blocks are next to each other, that every free block has a matching footer, that the bit for the block before is right in every header, and that the roving pointer is at a header.  If there is memory that is not accounted for or any of these checks fail, validate_heap returns false, and otherwise it returns true.
 */
 
 bool validate_heap() {
     void *temp = segment_start;  // creating a temporary pointer to traverse the headers of the heap
     size_t count = 0;  // create a variable to keep track of the accountned for memory
     void *end_heap = (char *)segment_start + segment_size;
+    size_t free_blocks = 0;  // create a variable to count the free blocks
+    size_t free_bytes = 0;  // create a variable to add up the payload bytes of the free blocks
+#ifdef NEXT_FIT
+    bool prev_free = false;  // whether the block before temp is free
+    bool found_rover = false;  // whether the roving pointer is at one of the headers
+#endif
     // while there are still headers in the heap
     while (temp < end_heap) {
-        header *cur_header = (header *)temp;
-        size_t block_size = 0;  // create a variable to hold the size indicated by the header 
+        size_t block_size = get_size(temp) + HEADER_SIZE;  // add header size to block_size to account for headers
+        count += block_size;
         if (is_free(temp)) {
-            block_size = cur_header->size + HEADER_SIZE;  // add header size to block_size to account for headers
-            count += block_size;
-        } else {
-            block_size = cur_header->size - 1 + HEADER_SIZE;  // subtract one because the header is used
-            count += block_size;
+            free_blocks++;
+            free_bytes += get_size(temp);
+        }
+#ifdef NEXT_FIT
+        if (((((header *)temp)->size & PREV_FREE_BIT) != 0) != prev_free) {
+            return false;
         }
+        prev_free = is_free(temp);
+        if (prev_free) {
+            void *next = next_header(temp);
+            // a free block must end in a footer with its size and must not be followed by another free block
+            if (((header *)((char *)next - HEADER_SIZE))->size != get_size(temp) ||
+                (next < end_heap && is_free(next))) {
+                return false;
+            }
+        }
+        found_rover = found_rover || (temp == rover);
+#endif
         temp = (char *)temp + block_size;  // move temp to next header
     }
+#ifdef NEXT_FIT
+    if (!found_rover) {
+        return false;
+    }
+#endif
+    if (free_blocks != stats.free_blocks || free_bytes != stats.free_bytes) {
+        return false;
+    }
     return (count == segment_size);  // checks if the memory used by the blocks equals the total memory
 }
 
@@ -254,13 +545,11 @@ void dump_heap() {
     void *end_heap = (char *)segment_start + segment_size;
     // while there are headers left in the heap
     while (temp < end_heap) {
-        if (is_free(temp)) {
-            printf("%p, %c, %ld, %zx\n", temp, 'f', ((header *)temp)->size, ((header *)temp)->size + HEADER_SIZE);
-            temp = (char *)temp + HEADER_SIZE + ((header *)temp)->size;
-        } else {
-            size_t block_len = (((header *)temp)->size) - 1;
-            printf("%p, %c, %ld, %zx\n", temp, 'u', block_len, block_len + HEADER_SIZE);
-            temp = (char *)temp + HEADER_SIZE + (((header *)temp)->size - 1);
-        }
+        size_t block_len = get_size(temp);
+        printf("%p, %c, %ld, %zx\n", temp, is_free(temp) ? 'f' : 'u', block_len, block_len + HEADER_SIZE);
+        temp = next_header(temp);
     }        
+#ifdef NEXT_FIT
+    printf("rover at %p\n", rover);
+#endif
 }
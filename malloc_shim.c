@@ -0,0 +1,163 @@
+/* File: malloc_shim.c
+ * -------------------
+ * Standard malloc, free, realloc, calloc and the aligned allocation
+ * functions on top of the custom heap allocator, so the allocator can be
+ * built as a shared library and loaded into any program with LD_PRELOAD:
+ *
+ *     LD_PRELOAD=./libexplicit.so program [args]
+ *
+ * The heap is reserved through segment.c by the first call that needs it,
+ * since the C library and other libraries allocate memory before any
+ * constructor of this library would run.  The functions follow the C
+ * library where it differs from the my* functions: a request for 0 bytes
+ * returns a block that can be freed, a failed request sets errno, and
+ * memalign rounds an alignment that is not a power of two up.  The library
+ * is built with an ALIGNMENT of 16, so every block is aligned for any type,
+ * as on the C library, and no request can be bigger than MAX_REQUEST_SIZE.
+ *
+ * Only these functions are exported; the rest of the allocator is built
+ * with hidden visibility, so it can't clash with names in the program.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "allocator.h"
+#include "segment.h"
+
+#define HEAP_SIZE (1L << 32)
+
+#define EXPORT __attribute__((visibility("default")))
+
+static pthread_once_t heap_once = PTHREAD_ONCE_INIT;
+static bool heap_ready = false;
+
+
+/* Function: init_heap
+ * -------------------
+ * Reserves the heap segment and initializes the allocator on it.  Runs once,
+ * from the first call that needs the heap.
+ */
+static void init_heap() {
+    reserve_heap_segment(HEAP_SIZE);
+    __atomic_store_n(&heap_ready, myinit(heap_segment_start(), heap_segment_size()), __ATOMIC_RELEASE);
+}
+
+/* Function: ensure_heap
+ * ---------------------
+ * Returns true once the heap is initialized, initializing it on the first
+ * call.  After that, this only reads a flag.
+ */
+static inline bool ensure_heap() {
+    if (__builtin_expect(!__atomic_load_n(&heap_ready, __ATOMIC_ACQUIRE), 0)) {
+        pthread_once(&heap_once, init_heap);
+    }
+    return heap_ready;
+}
+
+/* Function: out_of_memory
+ * -----------------------
+ * Sets errno the way the C library does when it can't allocate, and returns
+ * NULL for the caller to return.
+ */
+static void *out_of_memory() {
+    errno = ENOMEM;
+    return NULL;
+}
+
+EXPORT void *malloc(size_t size) {
+    if (!ensure_heap()) {
+        return out_of_memory();
+    }
+    // mymalloc turns down 0 bytes, but malloc must return a block that can be freed
+    void *ptr = mymalloc((size == 0) ? 1 : size);
+    return (ptr != NULL) ? ptr : out_of_memory();
+}
+
+EXPORT void free(void *ptr) {
+    // nothing can have been allocated before the heap was initialized
+    if (ptr != NULL) {
+        myfree(ptr);
+    }
+}
+
+EXPORT void *calloc(size_t nmemb, size_t size) {
+    if (!ensure_heap()) {
+        return out_of_memory();
+    }
+    if (nmemb == 0 || size == 0) {
+        nmemb = size = 1;
+    }
+    void *ptr = mycalloc(nmemb, size);
+    return (ptr != NULL) ? ptr : out_of_memory();
+}
+
+EXPORT void *realloc(void *ptr, size_t size) {
+    if (!ensure_heap()) {
+        return out_of_memory();
+    }
+    // realloc to 0 bytes frees the block and returns NULL, which is not a failure
+    void *result = myrealloc(ptr, (ptr == NULL && size == 0) ? 1 : size);
+    return (result != NULL || size == 0) ? result : out_of_memory();
+}
+
+EXPORT void *reallocarray(void *ptr, size_t nmemb, size_t size) {
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        return out_of_memory();
+    }
+    return realloc(ptr, nmemb * size);
+}
+
+EXPORT void *memalign(size_t alignment, size_t size) {
+    if (!ensure_heap()) {
+        return out_of_memory();
+    }
+    // the C library rounds an alignment that is not a power of two up to one
+    if ((alignment & (alignment - 1)) != 0) {
+        if (alignment > MAX_REQUEST_SIZE) {
+            return out_of_memory();
+        }
+        alignment = (size_t)1 << (64 - __builtin_clzl(alignment));
+    }
+    void *ptr = mymemalign(alignment, (size == 0) ? 1 : size);
+    return (ptr != NULL) ? ptr : out_of_memory();
+}
+
+EXPORT int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment % sizeof(void *) != 0) {
+        return EINVAL;
+    }
+    int saved_errno = errno;  // posix_memalign reports failure only by its result
+    void *ptr = memalign(alignment, size);
+    if (ptr == NULL) {
+        errno = saved_errno;
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+EXPORT void *aligned_alloc(size_t alignment, size_t size) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return memalign(alignment, size);
+}
+
+EXPORT void *valloc(size_t size) {
+    return memalign(sysconf(_SC_PAGESIZE), size);
+}
+
+EXPORT void *pvalloc(size_t size) {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    if (size > SIZE_MAX - page_size) {
+        return out_of_memory();
+    }
+    return memalign(page_size, (size + page_size - 1) & ~(page_size - 1));
+}
+
+EXPORT size_t malloc_usable_size(void *ptr) {
+    return mymalloc_usable_size(ptr);
+}
@@ -4,10 +4,10 @@
  * when allocating memory.  Optionally write any program you'd
  * like below that allocates memory, using mymalloc, myrealloc,
  * and myfree instead of malloc, realloc and free, and see your
- * heap allocator in action!  (Note: if your code uses indirect 
- * heap-allocating functions like calloc or strdup, you will have
- * to implement this functionality in other ways to have it use
- * your custom heap allocator). 
+ * heap allocator in action!  Use mycalloc in place of calloc.
+ * (Note: if your code uses indirect heap-allocating functions
+ * like strdup, you will have to implement this functionality in
+ * other ways to have it use your custom heap allocator). 
  *
  * When you compile using `make`, it will create 3 different
  * compiled versions of this program, one using each type of
@@ -22,7 +22,7 @@
 #define HEAP_SIZE 1L << 32
 
 bool initialize_heap_allocator() {
-    init_heap_segment(HEAP_SIZE);
+    reserve_heap_segment(HEAP_SIZE);
     return myinit(heap_segment_start(), heap_segment_size());
 }
 
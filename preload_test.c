@@ -0,0 +1,229 @@
+/* File: preload_test.c
+ * --------------------
+ * A program that uses the standard allocation functions the way ordinary
+ * programs do, and checks what they return, for running under a library
+ * loaded with LD_PRELOAD.  Every block must be aligned to 16 bytes, as
+ * malloc on x86-64 promises, or to the alignment asked for, must have at
+ * least the requested usable size, and must keep its contents through
+ * realloc.  calloc blocks must be zero.  A child forked while other threads
+ * are allocating must be able to allocate too.
+ *
+ * Usage: LD_PRELOAD=./libexplicit.so ./preload_test
+ * Exits with status 1 and a message for the first check that fails.
+ */
+
+#define _GNU_SOURCE  // for aligned_alloc, which gnu99 does not declare
+#include <malloc.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// alignment malloc must give every block, that of max_align_t on x86-64
+#define MALLOC_ALIGNMENT 16
+
+// number of blocks kept live at once
+#define NUM_BLOCKS 512
+
+// size of the blocks big enough to get a mapping of their own from the explicit allocator
+#define HUGE_SIZE (32UL << 20)
+
+// number of threads allocating while the main thread forks, and number of forks
+#define NUM_FORK_THREADS 3
+#define NUM_FORKS 200
+
+// seconds a forked child gets to allocate before it counts as deadlocked
+#define CHILD_SECONDS 10
+
+
+/* Function: check_block
+ * ---------------------
+ * Exits with a message if ptr is NULL, is not aligned to alignment, or has
+ * fewer than size usable bytes.
+ */
+static void check_block(const char *what, void *ptr, size_t size, size_t alignment) {
+    if (ptr == NULL) {
+        fprintf(stderr, "preload_test: %s of %zu bytes returned NULL\n", what, size);
+        exit(1);
+    }
+    if ((uintptr_t)ptr % alignment != 0) {
+        fprintf(stderr, "preload_test: %s of %zu bytes returned %p, not aligned to %zu\n", what, size, ptr, alignment);
+        exit(1);
+    }
+    if (malloc_usable_size(ptr) < size) {
+        fprintf(stderr, "preload_test: %s of %zu bytes has only %zu usable\n", what, size, malloc_usable_size(ptr));
+        exit(1);
+    }
+}
+
+/* Function: check_contents
+ * ------------------------
+ * Exits with a message if the first size bytes at ptr are not all value.
+ */
+static void check_contents(const char *what, const unsigned char *ptr, size_t size, unsigned char value) {
+    for (size_t i = 0; i < size; i++) {
+        if (ptr[i] != value) {
+            fprintf(stderr, "preload_test: byte %zu of a %s block of %zu bytes is %d, not %d\n", i, what, size, ptr[i], value);
+            exit(1);
+        }
+    }
+}
+
+/* Function: check_sizes
+ * ---------------------
+ * Allocates, fills, reallocates and frees blocks of many sizes, small ones
+ * for slabs and thread caches as well as heap blocks, keeping NUM_BLOCKS of
+ * them live at once so freed space is reused.  Returns the number of blocks
+ * checked.
+ */
+static int check_sizes() {
+    void *blocks[NUM_BLOCKS] = {NULL};
+    size_t sizes[NUM_BLOCKS] = {0};
+    unsigned int seed = 107;
+    int nchecked = 0;
+    for (int i = 0; i < 20000; i++) {
+        int slot = rand_r(&seed) % NUM_BLOCKS;
+        size_t size = (i % 3 == 0) ? rand_r(&seed) % 5000 : rand_r(&seed) % 128;
+        if (blocks[slot] != NULL) {
+            check_contents("malloc", blocks[slot], sizes[slot], (unsigned char)slot);
+        }
+        if (i % 7 == 0 && blocks[slot] != NULL) {
+            // realloc keeps the bytes both sizes share
+            size_t kept = (size < sizes[slot]) ? size : sizes[slot];
+            blocks[slot] = realloc(blocks[slot], size + 1);
+            check_block("realloc", blocks[slot], size + 1, MALLOC_ALIGNMENT);
+            check_contents("realloc", blocks[slot], kept, (unsigned char)slot);
+        } else {
+            free(blocks[slot]);
+            if (i % 5 == 0) {
+                blocks[slot] = calloc(1, size);
+                check_block("calloc", blocks[slot], size, MALLOC_ALIGNMENT);
+                check_contents("calloc", blocks[slot], size, 0);
+            } else {
+                blocks[slot] = malloc(size);
+                check_block("malloc", blocks[slot], size, MALLOC_ALIGNMENT);
+            }
+        }
+        sizes[slot] = size;
+        memset(blocks[slot], slot, size);
+        nchecked++;
+    }
+    for (int slot = 0; slot < NUM_BLOCKS; slot++) {
+        free(blocks[slot]);
+    }
+    return nchecked;
+}
+
+/* Function: check_huge
+ * --------------------
+ * Checks blocks big enough to get a mapping of their own, through malloc,
+ * calloc and a realloc that grows one.  Returns the number of blocks
+ * checked.
+ */
+static int check_huge() {
+    char *ptr = malloc(HUGE_SIZE);
+    check_block("malloc", ptr, HUGE_SIZE, MALLOC_ALIGNMENT);
+    memset(ptr, 7, HUGE_SIZE);
+    ptr = realloc(ptr, 2 * HUGE_SIZE);
+    check_block("realloc", ptr, 2 * HUGE_SIZE, MALLOC_ALIGNMENT);
+    check_contents("realloc", (unsigned char *)ptr, HUGE_SIZE, 7);
+    free(ptr);
+    ptr = calloc(HUGE_SIZE, 1);
+    check_block("calloc", ptr, HUGE_SIZE, MALLOC_ALIGNMENT);
+    check_contents("calloc", (unsigned char *)ptr, HUGE_SIZE, 0);
+    free(ptr);
+    return 3;
+}
+
+/* Function: check_aligned
+ * -----------------------
+ * Checks the aligned allocation functions for alignments from 16 bytes to a
+ * page.  Returns the number of blocks checked.
+ */
+static int check_aligned() {
+    int nchecked = 0;
+    for (size_t alignment = MALLOC_ALIGNMENT; alignment <= 4096; alignment *= 2) {
+        void *ptr = NULL;
+        if (posix_memalign(&ptr, alignment, 100) != 0) {
+            ptr = NULL;
+        }
+        check_block("posix_memalign", ptr, 100, alignment);
+        void *other = aligned_alloc(alignment, 3 * alignment);
+        check_block("aligned_alloc", other, 3 * alignment, alignment);
+        void *third = memalign(alignment, 1);
+        check_block("memalign", third, 1, alignment);
+        free(ptr);
+        free(other);
+        free(third);
+        nchecked += 3;
+    }
+    return nchecked;
+}
+
+/* Function: churn
+ * ---------------
+ * Thread function for check_fork: allocates and frees blocks too big for the
+ * thread caches, so the thread spends most of its time holding the heap
+ * lock, until *stop is set.
+ */
+static void *churn(void *stop) {
+    unsigned int seed = (uintptr_t)&seed;
+    while (!__atomic_load_n((bool *)stop, __ATOMIC_RELAXED)) {
+        void *ptr = malloc(1000 + rand_r(&seed) % 20000);
+        memset(ptr, 1, 1000);
+        free(ptr);
+    }
+    return NULL;
+}
+
+/* Function: check_fork
+ * --------------------
+ * Forks NUM_FORKS children while NUM_FORK_THREADS threads allocate.  Each
+ * child allocates and frees blocks of its own and exits; one that can't
+ * finish within CHILD_SECONDS, because the heap lock was copied held by a
+ * thread that does not exist in the child, is killed by its alarm.  Returns
+ * the number of blocks checked.
+ */
+static int check_fork() {
+    pthread_t threads[NUM_FORK_THREADS];
+    bool stop = false;
+    for (int i = 0; i < NUM_FORK_THREADS; i++) {
+        pthread_create(&threads[i], NULL, churn, &stop);
+    }
+    int nchecked = 0;
+    for (int i = 0; i < NUM_FORKS; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            alarm(CHILD_SECONDS);
+            for (size_t size = 1; size <= 100000; size *= 3) {
+                void *ptr = malloc(size);
+                check_block("malloc in a forked child", ptr, size, MALLOC_ALIGNMENT);
+                free(ptr);
+            }
+            _exit(0);
+        }
+        int status = 0;
+        if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "preload_test: forked child %d did not finish its allocations (%s)\n", i,
+                    (pid > 0 && WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM) ? "deadlocked" : "failed");
+            exit(1);
+        }
+        nchecked += 11;
+    }
+    __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+    for (int i = 0; i < NUM_FORK_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    return nchecked;
+}
+
+int main(int argc, char *argv[]) {
+    int nchecked = check_sizes() + check_huge() + check_aligned() + check_fork();
+    printf("preload_test: %d blocks checked\n", nchecked);
+    return 0;
+}
@@ -0,0 +1,97 @@
+/* File: record_test.c
+ * -------------------
+ * A small program to record with the trace recorder.  Two threads each make
+ * a fixed mix of every request the recorder wraps: malloc, calloc, realloc
+ * that grows, shrinks, starts from NULL and frees, free, posix_memalign,
+ * memalign and aligned_alloc, with blocks freed in a different order than
+ * they were allocated, so ids are reused.  The trace it leaves must replay
+ * cleanly in the harness:
+ *
+ *     TRACE_FILE=record_test.script LD_PRELOAD=./libtrace_recorder.so ./record_test
+ *     ./test_explicit record_test.script
+ */
+
+#define _GNU_SOURCE  // for aligned_alloc, which gnu99 does not declare
+#include <malloc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// number of threads making requests, and rounds of requests each makes
+#define NUM_THREADS 2
+#define NUM_ROUNDS 2000
+
+// number of blocks each thread keeps live at once
+#define NUM_BLOCKS 64
+
+
+/* Function: make_requests
+ * -----------------------
+ * Thread function that makes NUM_ROUNDS rounds of requests on a set of
+ * NUM_BLOCKS slots, replacing the block in a slot with one from a different
+ * function each round, and frees what is left at the end.  Returns NULL.
+ */
+static void *make_requests(void *arg) {
+    unsigned int seed = (unsigned int)(size_t)arg;
+    void *blocks[NUM_BLOCKS] = {NULL};
+    for (int round = 0; round < NUM_ROUNDS; round++) {
+        int slot = rand_r(&seed) % NUM_BLOCKS;
+        size_t size = 1 + rand_r(&seed) % ((round % 10 == 0) ? 20000 : 300);
+        size_t alignment = (size_t)16 << (rand_r(&seed) % 6);
+        switch (round % 8) {
+            case 0:
+                free(blocks[slot]);
+                blocks[slot] = malloc(size);
+                break;
+            case 1:
+                free(blocks[slot]);
+                blocks[slot] = calloc(1, size);
+                break;
+            case 2:
+                // realloc of NULL allocates, and otherwise the block grows or shrinks
+                blocks[slot] = realloc(blocks[slot], size);
+                break;
+            case 3:
+                free(blocks[slot]);
+                if (posix_memalign(&blocks[slot], alignment, size) != 0) {
+                    blocks[slot] = NULL;
+                }
+                break;
+            case 4:
+                free(blocks[slot]);
+                blocks[slot] = memalign(alignment, size);
+                break;
+            case 5:
+                free(blocks[slot]);
+                blocks[slot] = aligned_alloc(alignment, alignment * (1 + size / alignment));
+                break;
+            case 6:
+                // realloc to 0 bytes frees the block
+                blocks[slot] = realloc(blocks[slot], 0);
+                break;
+            default:
+                free(blocks[slot]);
+                blocks[slot] = NULL;
+        }
+        if (blocks[slot] != NULL) {
+            memset(blocks[slot], round, 1);
+        }
+    }
+    for (int slot = NUM_BLOCKS - 1; slot >= 0; slot--) {
+        free(blocks[slot]);
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    pthread_t threads[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; i++) {
+        pthread_create(&threads[i], NULL, make_requests, (void *)(size_t)(i + 1));
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    printf("record_test: %d rounds of requests made\n", NUM_THREADS * NUM_ROUNDS);
+    return 0;
+}
@@ -1,23 +1,57 @@
 /* File: segment.c
  * ---------------
  * Handles low-level storage underneath the heap allocator. It reserves
- * the large memory segment using the OS-level mmap facility.
+ * the large memory segment using the OS-level mmap facility.  An allocator
+ * that runs out of room can chain extra chunks after the segment with
+ * extend_heap_segment; they are unmapped along with it.  Blocks too big
+ * for the heap can get a mapping of their own, a region, with
+ * map_heap_region.
  *
  * Written by jzelenski, updated Spring 2018
  */
 
+#define _GNU_SOURCE  // for mremap
 #include "segment.h"
 #include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 #include <sys/mman.h>
+#include <unistd.h>
 
 /* Place segment at fixed address, as default addresses are quite high
  * and easily mistaken for stack addresses.
  */
 #define HEAP_START_HINT (void *)0x107000000L
 
+// Size of the huge pages the segment asks for (the x86-64 default)
+#define HUGE_PAGE_SIZE (2UL << 20)
+
+// Most chunks that can be chained after the segment
+#define MAX_HEAP_CHUNKS 64
+
 // Static means these variables are only visible within this file
 static void *segment_start = NULL;
 static size_t segment_size = 0;
+static size_t mapped_size = 0;  // bytes actually mapped, can be more than segment_size with huge pages
+static size_t page_size = 0;
+static bool segment_fresh = false;  // true from mapping the segment until heap_segment_fresh is asked about it
+
+// Extra chunks added by extend_heap_segment, in the order they were added
+static void *chunk_starts[MAX_HEAP_CHUNKS];
+static size_t chunk_sizes[MAX_HEAP_CHUNKS];
+static int num_chunks = 0;
+
+// Header at the start of every region, linking the regions into a list
+typedef struct region {
+    struct region *next;
+    struct region *prev;
+    size_t mapped;  // bytes in the mapping, including this header
+    size_t unused;  // keeps the bytes after the header aligned to 16
+} region;
+
+static region *regions = NULL;
+static size_t region_bytes = 0;  // bytes in all regions
 
 void *heap_segment_start() {
     return segment_start;
@@ -27,17 +61,236 @@ size_t heap_segment_size() {
     return segment_size;
 }
 
-void *init_heap_segment(size_t total_size) {
-    // Discard any previous segment via munmap
+size_t heap_segment_page_size() {
+    return page_size;
+}
+
+bool heap_segment_fresh(void *start) {
+    bool fresh = segment_fresh && start == segment_start;
+    segment_fresh = false;
+    return fresh;
+}
+
+int heap_segment_chunks() {
+    return num_chunks + 1;
+}
+
+void *heap_chunk_start(int chunk) {
+    return (chunk == 0) ? segment_start : chunk_starts[chunk - 1];
+}
+
+size_t heap_chunk_size(int chunk) {
+    return (chunk == 0) ? segment_size : chunk_sizes[chunk - 1];
+}
+
+bool heap_segment_contains(void *ptr, size_t size) {
+    for (int chunk = 0; chunk < heap_segment_chunks(); chunk++) {
+        char *start = heap_chunk_start(chunk);
+        if ((char *)ptr >= start && (char *)ptr + size <= start + heap_chunk_size(chunk)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t heap_segment_offset(void *ptr) {
+    size_t offset = 0;
+    for (int chunk = 0; chunk < heap_segment_chunks(); chunk++) {
+        char *start = heap_chunk_start(chunk);
+        if ((char *)ptr >= start && (char *)ptr <= start + heap_chunk_size(chunk)) {
+            return offset + ((char *)ptr - start);
+        }
+        offset += heap_chunk_size(chunk);
+    }
+    return offset;
+}
+
+bool release_heap_chunks() {
+    for (; num_chunks > 0; num_chunks--) {
+        if (munmap(chunk_starts[num_chunks - 1], chunk_sizes[num_chunks - 1]) == -1) return false;
+    }
+    return true;
+}
+
+void *extend_heap_segment(size_t size) {
+    if (segment_start == NULL || num_chunks == MAX_HEAP_CHUNKS) return NULL;
+    size_t normal_page_size = sysconf(_SC_PAGESIZE);
+    size = (size + normal_page_size - 1) & ~(normal_page_size - 1);
+
+    // Ask for the chunk right after the last one, so the heap stays in one place when it can
+    int last = num_chunks;
+    void *hint = (char *)heap_chunk_start(last) + ((last == 0) ? mapped_size : heap_chunk_size(last));
+    void *chunk = mmap(hint, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if (chunk == MAP_FAILED) return NULL;
+    chunk_starts[num_chunks] = chunk;
+    chunk_sizes[num_chunks] = size;
+    num_chunks++;
+    return chunk;
+}
+
+/* Returns the number of bytes to map for a region with size usable bytes.
+ */
+static size_t region_length(size_t size) {
+    size_t normal_page_size = sysconf(_SC_PAGESIZE);
+    return (sizeof(region) + size + normal_page_size - 1) & ~(normal_page_size - 1);
+}
+
+void *map_heap_region(size_t size) {
+    size_t length = region_length(size);
+    region *cur = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if (cur == MAP_FAILED) return NULL;
+    cur->mapped = length;
+    cur->prev = NULL;
+    cur->next = regions;
+    if (regions != NULL) {
+        regions->prev = cur;
+    }
+    regions = cur;
+    region_bytes += length;
+    return cur + 1;
+}
+
+void *remap_heap_region(void *ptr, size_t size) {
+    region *cur = (region *)ptr - 1;
+    size_t length = region_length(size);
+    region *moved = mremap(cur, cur->mapped, length, MREMAP_MAYMOVE);
+    if (moved == MAP_FAILED) return NULL;
+    // the header moved with the data, so its neighbours must point to the new place
+    if (moved->prev != NULL) {
+        moved->prev->next = moved;
+    } else {
+        regions = moved;
+    }
+    if (moved->next != NULL) {
+        moved->next->prev = moved;
+    }
+    region_bytes += length - moved->mapped;
+    moved->mapped = length;
+    return moved + 1;
+}
+
+void unmap_heap_region(void *ptr) {
+    region *cur = (region *)ptr - 1;
+    if (cur->prev != NULL) {
+        cur->prev->next = cur->next;
+    } else {
+        regions = cur->next;
+    }
+    if (cur->next != NULL) {
+        cur->next->prev = cur->prev;
+    }
+    region_bytes -= cur->mapped;
+    munmap(cur, cur->mapped);
+}
+
+void *heap_region_next(void *ptr) {
+    region *next = (ptr == NULL) ? regions : ((region *)ptr - 1)->next;
+    return (next == NULL) ? NULL : next + 1;
+}
+
+size_t heap_region_size(void *ptr) {
+    return ((region *)ptr - 1)->mapped - sizeof(region);
+}
+
+bool heap_region_contains(void *ptr, size_t size) {
+    for (void *cur = heap_region_next(NULL); cur != NULL; cur = heap_region_next(cur)) {
+        if ((char *)ptr >= (char *)cur && (char *)ptr + size <= (char *)cur + heap_region_size(cur)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t heap_region_bytes() {
+    return region_bytes;
+}
+
+/* Unmaps the current segment, its chunks and every region, if there is a
+ * segment.  Returns false if munmap fails.
+ */
+static bool unmap_heap_segment() {
+    while (regions != NULL) {
+        unmap_heap_region(regions + 1);
+    }
+    if (!release_heap_chunks()) return false;
     if (segment_start != NULL) {
-        if (munmap(segment_start, total_size) == -1) return NULL;
+        if (munmap(segment_start, mapped_size) == -1) return false;
         segment_start = NULL;
         segment_size = 0;
+        mapped_size = 0;
     }
+    return true;
+}
+
+/* Maps a new segment of total_size bytes with the given extra mmap flags,
+ * discarding any previous segment first.
+ */
+static void *map_heap_segment(size_t total_size, int flags) {
+    // Discard any previous segment via munmap
+    if (!unmap_heap_segment()) return NULL;
     
     // Re-initialize by reserving entire segment with mmap
-    segment_start = mmap(HEAP_START_HINT, total_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    segment_start = mmap(HEAP_START_HINT, total_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|flags, -1, 0);
     assert(segment_start != MAP_FAILED);
     segment_size = total_size;
+    mapped_size = total_size;
+    page_size = sysconf(_SC_PAGESIZE);
+    segment_fresh = true;
+    return segment_start;
+}
+
+void *init_heap_segment(size_t total_size) {
+    return map_heap_segment(total_size, 0);
+}
+
+void *reserve_heap_segment(size_t total_size) {
+    return map_heap_segment(total_size, MAP_NORESERVE);
+}
+
+/* Returns true if the kernel will back memory advised with MADV_HUGEPAGE
+ * with transparent huge pages, that is, if they are not turned off.
+ */
+static bool transparent_huge_pages_enabled() {
+    FILE *fp = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    if (fp == NULL) return false;
+    char setting[64] = "";
+    bool enabled = fgets(setting, sizeof(setting), fp) != NULL && strstr(setting, "[never]") == NULL;
+    fclose(fp);
+    return enabled;
+}
+
+void *init_heap_segment_huge(size_t total_size) {
+    if (!unmap_heap_segment()) return NULL;
+    size_t huge_size = (total_size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+    // Use pages from hugetlbfs if enough of them are reserved for the whole segment
+    segment_start = mmap(HEAP_START_HINT, huge_size, PROT_READ|PROT_WRITE,
+                         MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+    if (segment_start != MAP_FAILED) {
+        segment_size = total_size;
+        mapped_size = huge_size;
+        page_size = HUGE_PAGE_SIZE;
+        segment_fresh = true;
+        return segment_start;
+    }
+
+    // Otherwise map an extra huge page so a huge-page-aligned start can be
+    // cut out of it, and ask for transparent huge pages
+    char *mapping = mmap(HEAP_START_HINT, huge_size + HUGE_PAGE_SIZE, PROT_READ|PROT_WRITE,
+                         MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    assert(mapping != MAP_FAILED);
+    char *aligned = (char *)(((uintptr_t)mapping + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+    if (aligned > mapping) {
+        munmap(mapping, aligned - mapping);
+    }
+    if (aligned + huge_size < mapping + huge_size + HUGE_PAGE_SIZE) {
+        munmap(aligned + huge_size, mapping + HUGE_PAGE_SIZE - aligned);
+    }
+    segment_start = aligned;
+    segment_size = total_size;
+    mapped_size = huge_size;
+    bool advised = madvise(segment_start, mapped_size, MADV_HUGEPAGE) == 0;
+    page_size = (advised && transparent_huge_pages_enabled()) ? HUGE_PAGE_SIZE : (size_t)sysconf(_SC_PAGESIZE);
+    segment_fresh = true;
     return segment_start;
 }
@@ -6,6 +6,7 @@
 
 #ifndef _SEGMENT_H_
 #define _SEGMENT_H_
+#include <stdbool.h> // for bool
 #include <stddef.h> // for size_t
 
 
@@ -21,6 +22,29 @@
 void *init_heap_segment(size_t total_size);
 
 
+/* Function: reserve_heap_segment
+ * ------------------------------
+ * The same as init_heap_segment, but the segment only reserves address
+ * space.  It is mapped with MAP_NORESERVE, so no swap is set aside for it,
+ * and each page is only committed when it is first touched.  Pages that the
+ * allocator later hands back with madvise are uncommitted again, so a
+ * process that reserves a large segment only pays for what it is using.
+ */
+void *reserve_heap_segment(size_t total_size);
+
+
+/* Function: init_heap_segment_huge
+ * --------------------------------
+ * The same as reserve_heap_segment, but the segment is backed by 2 MiB huge
+ * pages where possible, to cut TLB misses when a large heap is touched at
+ * random.  If hugetlbfs has enough pages reserved for the whole segment, it
+ * is mapped with MAP_HUGETLB.  Otherwise the segment is aligned to 2 MiB and
+ * advised with MADV_HUGEPAGE, so the kernel can back it with transparent
+ * huge pages.  heap_segment_page_size reports which page size was used.
+ */
+void *init_heap_segment_huge(size_t total_size);
+
+
 
 /* Functions: heap_segment_start, heap_segment_size
  * ------------------------------------------------
@@ -32,4 +56,113 @@ void *heap_segment_start();
 size_t heap_segment_size();
 
 
+/* Function: heap_segment_page_size
+ * --------------------------------
+ * Returns the size in bytes of the pages backing the current segment: the
+ * huge page size if init_heap_segment_huge got hugetlbfs pages, or got
+ * transparent huge pages advised while the kernel has them enabled, and
+ * the normal page size otherwise.
+ */
+size_t heap_segment_page_size();
+
+
+/* Function: heap_segment_fresh
+ * ----------------------------
+ * Returns true if start is the base address of a segment that was just
+ * mapped and has not been asked about before, so every byte of it is still
+ * zero.  An allocator can call this from myinit to learn that it does not
+ * have to zero memory it has never handed out.  Any later call for the
+ * same segment returns false, since the heap may have written to it by then.
+ */
+bool heap_segment_fresh(void *start);
+
+
+/* Function: extend_heap_segment
+ * -----------------------------
+ * Maps a new chunk of at least size bytes, rounded up to a whole number of
+ * pages, and chains it after the segment and any chunks added before it.
+ * The chunk is placed right after the last one when that address is free,
+ * but it may end up anywhere, so an allocator must treat each chunk as a
+ * separate region.  Like reserve_heap_segment, its pages are only committed
+ * when touched.  Returns the start of the chunk, or NULL if there is no
+ * segment, the segment already has MAX_HEAP_CHUNKS chunks chained after it,
+ * or the chunk could not be mapped.  Chunks are unmapped when the segment is
+ * re-initialized.
+ */
+void *extend_heap_segment(size_t size);
+
+
+/* Function: release_heap_chunks
+ * -----------------------------
+ * Unmaps every chunk added by extend_heap_segment, leaving the segment
+ * itself and any regions alone, so they stop counting toward the limit on
+ * chunks.  An allocator calls this from myinit to start a new heap on the
+ * segment without the chunks of the old one.  Returns false if munmap fails.
+ */
+bool release_heap_chunks();
+
+
+/* Functions: heap_segment_chunks, heap_chunk_start, heap_chunk_size
+ * -----------------------------------------------------------------
+ * heap_segment_chunks returns the number of chunks of the heap, counting
+ * the segment itself as chunk 0 and the chunks added by
+ * extend_heap_segment after it in the order they were added.
+ * heap_chunk_start and heap_chunk_size return the base address and size
+ * in bytes of one of those chunks.
+ */
+int heap_segment_chunks();
+void *heap_chunk_start(int chunk);
+size_t heap_chunk_size(int chunk);
+
+
+/* Functions: heap_segment_contains, heap_segment_offset
+ * -----------------------------------------------------
+ * heap_segment_contains returns true if the size bytes at ptr lie within a
+ * single chunk of the heap.  heap_segment_offset returns how far ptr is
+ * from the start of the heap if the chunks were laid end to end in order,
+ * which measures how much of the heap is in use up to ptr.  ptr may be the
+ * end of a chunk.
+ */
+bool heap_segment_contains(void *ptr, size_t size);
+size_t heap_segment_offset(void *ptr);
+
+
+/* Functions: map_heap_region, remap_heap_region, unmap_heap_region
+ * ----------------------------------------------------------------
+ * A region is a mapping of its own, outside the segment, for a block too big
+ * to be worth placing in the heap.  map_heap_region maps a region with at
+ * least size usable bytes and returns a pointer to them, aligned to 16, or
+ * NULL if it could not be mapped.  remap_heap_region resizes a region with
+ * mremap, which may move it without copying its pages, and returns the new
+ * pointer to its usable bytes, or NULL if the old region is unchanged
+ * because it could not be resized.  unmap_heap_region gives a region back to
+ * the system right away.  Regions are also unmapped when the segment is
+ * re-initialized.
+ */
+void *map_heap_region(size_t size);
+void *remap_heap_region(void *ptr, size_t size);
+void unmap_heap_region(void *ptr);
+
+
+/* Functions: heap_region_next, heap_region_size
+ * ---------------------------------------------
+ * heap_region_next returns the region after ptr in the list of regions, or
+ * the first region if ptr is NULL, or NULL if there are no more.
+ * heap_region_size returns the number of usable bytes of a region, which can
+ * be more than were asked for since regions are whole pages.
+ */
+void *heap_region_next(void *ptr);
+size_t heap_region_size(void *ptr);
+
+
+/* Functions: heap_region_contains, heap_region_bytes
+ * --------------------------------------------------
+ * heap_region_contains returns true if the size bytes at ptr lie within a
+ * single region.  heap_region_bytes returns the number of bytes mapped for
+ * all regions together.
+ */
+bool heap_region_contains(void *ptr, size_t size);
+size_t heap_region_bytes();
+
+
 #endif
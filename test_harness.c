@@ -13,13 +13,19 @@
  */
 
 #include <error.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 #include "allocator.h"
 #include "segment.h"
 
@@ -31,12 +37,20 @@
 enum request_type {
     ALLOC = 1,
     FREE,
-    REALLOC
+    REALLOC,
+    BATCH_ALLOC,
+    BATCH_FREE,
+    ALIGNED_ALLOC,
+    CALLOC,
+    SIZED_FREE
 };
+// the fields are ordered so that there is no padding, since binary traces store request_t as is
 typedef struct {
-    enum request_type op;   // type of request
-    int id;                 // id for free() to use later
     size_t size;            // num bytes for alloc/realloc request
+    size_t alignment;       // alignment the block must have
+    enum request_type op;   // type of request
+    int id;                 // id for free() to use later, the first of the ids of a batch
+    int count;              // number of blocks in a batch request, with consecutive ids
     int lineno;             // which line in file
 } request_t;
 
@@ -46,6 +60,29 @@ typedef struct {
     size_t size;
 } block_t;
 
+// node of the index of live blocks for the block with the same id, a treap ordered by address
+typedef struct {
+    int left;           // id of the block in the left subtree, or -1
+    int right;          // id of the block in the right subtree, or -1
+    unsigned priority;  // heap order of the treap, a parent's priority is at least its children's
+} index_node_t;
+
+// state of a script that is read in chunks by a reader thread while it is replayed
+typedef struct {
+    FILE *fp;               // the text script or binary trace being read
+    char name[128];         // short name of the script, for errors from the reader
+    bool binary;            // whether fp holds request_t records instead of lines
+    int lineno;             // lines of a text script read so far
+    request_t *chunks[2];   // the chunk being replayed and the chunk being read ahead
+    int counts[2];          // number of requests in each chunk, 0 once the script has ended
+    bool filled[2];         // whether a chunk has been read and not yet replayed
+    int next;               // the chunk that is replayed next
+    bool stop;              // set when the replay ends early, so the reader stops
+    pthread_t reader;
+    pthread_mutex_t lock;   // protects counts, filled and stop
+    pthread_cond_t changed; // signaled when a chunk is filled or given back, or stop is set
+} stream_t;
+
 // struct for info for one script file
 typedef struct {
     char name[128];     // short name of script
@@ -53,30 +90,85 @@ typedef struct {
     int num_ops;        // number of requests
     int num_ids;        // number of distinct block ids
     block_t *blocks;    // array of memory blocks malloc returns when executing
+    index_node_t *index; // index nodes of the blocks, by id
+    int index_root;     // id of the root of the index, or -1 if no block is live
     size_t peak_size;   // total payload bytes at peak in-use
+    size_t peak_mapped; // bytes mapped for blocks outside the segment at peak
+    long *latencies;    // nanoseconds taken by each request, or NULL if not timing
+    size_t mapped_size; // bytes of the binary trace mapped in front of and at ops, or 0 if ops was parsed
+    stream_t *stream;   // reads the requests in chunks if the script is streamed, or NULL
+    long total_ops;     // requests replayed, over every chunk of a streamed script
 } script_t;
 
+/* A binary trace is this header followed by num_ops request_t records,
+ * exactly as they are laid out in memory, so the records can be used as
+ * script.ops where they are mapped.  The line numbers in the records are
+ * those of the script the trace was converted from.
+ */
+typedef struct {
+    char magic[8];          // TRACE_MAGIC, which can not start a line of a text script
+    uint32_t version;       // TRACE_VERSION
+    uint32_t record_size;   // sizeof(request_t) in the harness that wrote the trace
+    uint64_t num_ops;       // number of requests
+    uint64_t num_ids;       // number of distinct block ids
+} trace_header_t;
+
+#define TRACE_MAGIC "\x7f" "ATRACE"
+#define TRACE_VERSION 1
+
 // Amount by which we resize ops when needed when reading in from file
 const int OPS_RESIZE_AMOUNT = 500;
 
+// Number of requests in each of the two chunks of a streamed script
+const int STREAM_CHUNK_OPS = 1 << 16;
+
+// Limit on the ids of a streamed script, which bounds its blocks and index nodes to about 28 MB
+const int STREAM_MAX_IDS = 1 << 20;
+
 const int MAX_SCRIPT_LINE_LEN = 1024;
 
 const long HEAP_SIZE = 1L << 32;
 
+// Size of the segment the heap starts with when it is expected to grow (-g)
+const long SMALL_HEAP_SIZE = 1L << 20;
+
 
 /* FUNCTION PROTOTYPES */
 
 
-static int test_scripts(char *script_names[], int num_script_names, bool quiet);
+static int test_scripts(char *script_names[], int num_script_names, bool quiet, bool timing, bool huge_pages, bool small_heap, bool show_stats, int bench_reps, bool streaming);
 static bool read_line(char buffer[], size_t buffer_size, FILE *fp, int *pnread);
+static script_t load_script(const char *path);
 static script_t parse_script(const char *filename);
+static script_t map_trace(const char *path, int fd);
+static script_t open_stream(const char *path);
+static void *read_stream(void *arg);
+static bool next_chunk(script_t *script, int *preq);
+static void close_stream(stream_t *stream);
+static void grow_blocks(script_t *script, int num_ids);
+static void write_trace(script_t *script, const char *path);
+static void init_blocks(script_t *script);
+static void free_script(script_t *script);
 static request_t parse_script_line(char *buffer, int lineno, char *script_name);
-static size_t eval_correctness(script_t *script, bool quiet, bool *success);
+static bool valid_request(const request_t *request, int num_ids);
+static size_t eval_correctness(script_t *script, bool quiet, bool huge_pages, bool small_heap, bool *success);
+static bool eval_throughput(script_t *script, int reps, bool huge_pages, bool small_heap);
 static void *eval_malloc(int req, size_t requested_size, script_t *script, bool *failptr);
 static void *eval_realloc(int req, size_t requested_size, script_t *script, bool *failptr);
-static bool verify_block(void *ptr, size_t size, script_t *script, int lineno);
+static size_t eval_malloc_batch(int req, size_t requested_size, script_t *script, bool *failptr);
+static size_t eval_free_batch(int req, script_t *script, bool *failptr);
+static bool verify_block(void *ptr, size_t size, size_t alignment, script_t *script, int lineno);
 static bool verify_payload(void *ptr, size_t size, int id, script_t *script, int lineno, char *op);
+static void set_block(script_t *script, int id, void *ptr, size_t size);
+static int index_insert(script_t *script, int root, int id);
+static int index_remove(script_t *script, int root, int id);
+static int index_find_overlap(script_t *script, void *start, void *end);
 static void allocator_error(script_t *script, int lineno, char* format, ...);
+static long start_timer(script_t *script);
+static void stop_timer(script_t *script, int req, long start);
+static void report_latency(script_t *script);
+static void report_percentiles(const char *label, long latencies[], int n);
+static void report_stats(allocator_stats_t stats);
 
 
 /* CORRECTNESS EVALUATION IMPLEMENTATION */
@@ -84,37 +176,105 @@ static void allocator_error(script_t *script, int lineno, char* format, ...);
 
 /* Function: main
  * --------------
- * The main function parses command-line arguments (currently only -q for quiet)
- * and any script files that follow and runs the heap allocator on the specified
- * script files.  It outputs statistics about the run of each script, such as
- * the number of successful runs, number of failures, and average utilization.
+ * The main function parses command-line arguments (-q for quiet, -t to time
+ * each request, -H to back the heap with huge pages, -g to start from a small
+ * heap that the allocator must grow, -s to print the allocator's counters
+ * after each script, -b <reps> to benchmark throughput instead of checking
+ * correctness, -w to convert the scripts to binary traces instead of running
+ * them, -S to stream the scripts in chunks instead of loading them whole) and
+ * any script files that follow and runs the heap allocator
+ * on the specified script files.  It outputs statistics about the run of each
+ * script, such as the number of successful runs, number of failures, and
+ * average utilization.
+ *
+ * With -S, the memory the harness uses does not grow with the length of a
+ * script: it holds two chunks of STREAM_CHUNK_OPS requests, and a block and
+ * an index node for each id up to the largest one seen so far.  Ids must be
+ * below STREAM_MAX_IDS, which bounds that part too.  Scripts written by the
+ * trace recorder reuse the ids of freed blocks, so they stay well below it.
  */
 int main(int argc, char *argv[]) {
     // Parse command line arguments
     char c;
     bool quiet = false;
-    while ((c = getopt(argc, argv, "q")) != EOF) {
+    bool timing = false;
+    bool huge_pages = false;
+    bool small_heap = false;
+    bool show_stats = false;
+    int bench_reps = 0;
+    bool write_traces = false;
+    bool streaming = false;
+    while ((c = getopt(argc, argv, "qtHgsb:wS")) != EOF) {
         if (c == 'q') {
             quiet = true;
+        } else if (c == 't') {
+            timing = true;
+        } else if (c == 'H') {
+            huge_pages = true;
+        } else if (c == 'g') {
+            small_heap = true;
+        } else if (c == 's') {
+            show_stats = true;
+        } else if (c == 'b') {
+            bench_reps = atoi(optarg);
+            if (bench_reps < 1) {
+                error(1, 0, "The number of benchmark repetitions must be at least 1.");
+            }
+        } else if (c == 'w') {
+            write_traces = true;
+        } else if (c == 'S') {
+            streaming = true;
         }
     }
     if (optind >= argc) {
         error(1, 0, "Missing argument. Please supply one or more script files.");
     }
+    // timing, benchmarking and converting all need every request at once
+    if (streaming && (timing || bench_reps > 0 || write_traces)) {
+        error(1, 0, "-S can not be combined with -t, -b or -w.");
+    }
 
     // disable stdout buffering, all printfs display to terminal immediately
     setvbuf(stdout, NULL, _IONBF, 0);
-    
-    return test_scripts(argv + optind, argc - optind, quiet);
+
+    // each script is written next to itself as a binary trace, with .script replaced by .trace
+    if (write_traces) {
+        for (int i = optind; i < argc; i++) {
+            script_t script = load_script(argv[i]);
+            size_t stem = strlen(argv[i]);
+            if (stem >= strlen(".script") && strcmp(argv[i] + stem - strlen(".script"), ".script") == 0) {
+                stem -= strlen(".script");
+            }
+            char path[stem + strlen(".trace") + 1];
+            sprintf(path, "%.*s.trace", (int)stem, argv[i]);
+            write_trace(&script, path);
+            printf("Wrote %d requests of %s to %s\n", script.num_ops, script.name, path);
+            free_script(&script);
+        }
+        return 0;
+    }
+
+    return test_scripts(argv + optind, argc - optind, quiet, timing, huge_pages, small_heap, show_stats, bench_reps, streaming);
 }
 
 /* Function: test_scripts
  * ----------------------
  * Runs the scripts with names in the specified array, with more or less output
- * depending on the value of `quiet`.  Returns the number of failures during all
- * the tests.
+ * depending on the value of `quiet`.  If `timing` is set, each allocator call
+ * is timed and the latency of each successful script is reported.  If
+ * `huge_pages` is set, the heap segment is mapped with huge pages where the
+ * system has them, and the page size that was used is reported.  If
+ * `small_heap` is set, the heap segment starts at SMALL_HEAP_SIZE bytes and
+ * the allocator has to extend it to get through bigger scripts.  If
+ * `show_stats` is set, the counters from allocator_stats are printed after
+ * each successful script.  If `bench_reps` is not 0, each script is
+ * instead replayed that many times by eval_throughput with no checks at all,
+ * and only its throughput is reported.  If `streaming` is set, each script
+ * is read in chunks while it runs, so scripts of any length can be run in a
+ * bounded amount of memory.  Returns the number of failures during all the
+ * tests.
  */
-static int test_scripts(char *script_names[], int num_script_names, bool quiet) {
+static int test_scripts(char *script_names[], int num_script_names, bool quiet, bool timing, bool huge_pages, bool small_heap, bool show_stats, int bench_reps, bool streaming) {
     int nsuccesses = 0;
     int nfailures = 0;
 
@@ -122,29 +282,58 @@ static int test_scripts(char *script_names[], int num_script_names, bool quiet)
     int total_util = 0;
 
     for (int i = 0; i < num_script_names; i++) {
-        script_t script = parse_script(script_names[i]);
+        script_t script = streaming ? open_stream(script_names[i]) : load_script(script_names[i]);
+        if (bench_reps > 0) {
+            printf("\nBenchmarking allocator on %s...", script.name);
+            if (eval_throughput(&script, bench_reps, huge_pages, small_heap)) {
+                nsuccesses++;
+            } else {
+                nfailures++;
+            }
+            free_script(&script);
+            continue;
+        }
+        if (timing) {
+            script.latencies = calloc(script.num_ops, sizeof(long));
+            if (!script.latencies) {
+                error(1, 0, "Libc heap exhausted. Cannot continue.");
+            }
+        }
 
         // Evaluate this script and record the results
         printf("\nEvaluating allocator on %s...", script.name);
         bool success;
-        size_t used_segment = eval_correctness(&script, quiet, &success);
+        size_t used_segment = eval_correctness(&script, quiet, huge_pages, small_heap, &success);
         if (success) {
-            printf("successfully serviced %d requests. (payload/segment = %zu/%zu)", 
-                script.num_ops, script.peak_size, used_segment);
+            printf("successfully serviced %ld requests. (payload/segment = %zu/%zu)", 
+                script.total_ops, script.peak_size, used_segment);
+            if (script.peak_mapped > 0) {
+                printf("\n  of which mapped outside the segment: %zu", script.peak_mapped);
+            }
             if (used_segment > 0) {
                 total_util += (100 * script.peak_size) / used_segment;
             }
+            if (huge_pages) {
+                printf("\n  heap page size: %zu KiB", heap_segment_page_size() / 1024);
+            }
+            if (timing) {
+                report_latency(&script);
+            }
+            if (show_stats) {
+                report_stats(allocator_stats());
+            }
             nsuccesses++;
         } else {
             nfailures++;
         }
 
-        free(script.ops);
-        free(script.blocks);
+        free_script(&script);
     }
 
-    if (nsuccesses) {
+    if (nsuccesses && bench_reps == 0) {
         printf("\nUtilization averaged %d%%\n", total_util / nsuccesses);
+    } else if (bench_reps > 0) {
+        printf("\n");
     }
     return nfailures;
 }
@@ -154,12 +343,21 @@ static int test_scripts(char *script_names[], int num_script_names, bool quiet)
  * Check the allocator for correctness on given script. Interprets the
  * script operation-by-operation and reports if it detects any "obvious"
  * errors (returning blocks outside the heap, unaligned, 
- * overlapping blocks, etc.)
+ * overlapping blocks, etc.)  The heap segment is backed by huge pages if
+ * `huge_pages` is set, and starts at SMALL_HEAP_SIZE bytes if `small_heap`
+ * is set.  The returned size of the heap in use counts every chunk the
+ * allocator added to the segment as if they were laid end to end, plus the
+ * most bytes that were mapped at once for blocks in regions of their own.
  */
-static size_t eval_correctness(script_t *script, bool quiet, bool *success) {
+static size_t eval_correctness(script_t *script, bool quiet, bool huge_pages, bool small_heap, bool *success) {
     *success = false;
     
-    init_heap_segment(HEAP_SIZE);
+    size_t heap_size = small_heap ? SMALL_HEAP_SIZE : HEAP_SIZE;
+    if (huge_pages) {
+        init_heap_segment_huge(heap_size);
+    } else {
+        reserve_heap_segment(heap_size);
+    }
     if (!myinit(heap_segment_start(), heap_segment_size())) {
         allocator_error(script, 0, "myinit() returned false");
         return -1;
@@ -170,18 +368,20 @@ static size_t eval_correctness(script_t *script, bool quiet, bool *success) {
         return -1;
     }
 
-    // Track the topmost address used by the heap for utilization purposes
-    void *heap_end = heap_segment_start();
+    // Track the topmost offset used in the heap for utilization purposes
+    size_t heap_end = 0;
 
     // Track the current amount of memory allocated on the heap
     size_t cur_size = 0;
 
-    // Send each request to the heap allocator and check the resulting behavior
-    for (int req = 0; req < script->num_ops; req++) {
+    // Send each request to the heap allocator and check the resulting behavior,
+    // moving on to the next chunk at the end of each chunk of a streamed script
+    for (int req = 0; req < script->num_ops || next_chunk(script, &req); req++) {
         int id = script->ops[req].id;
         size_t requested_size = script->ops[req].size;
 
-        if (script->ops[req].op == ALLOC) {
+        if (script->ops[req].op == ALLOC || script->ops[req].op == ALIGNED_ALLOC ||
+            script->ops[req].op == CALLOC) {
             bool fail = false;
             void *p = eval_malloc(req, requested_size, script, &fail);
             if (fail) {
@@ -189,8 +389,10 @@ static size_t eval_correctness(script_t *script, bool quiet, bool *success) {
             }
 
             cur_size += requested_size;
-            if ((char *)p + requested_size > (char *)heap_end) {
-                heap_end = (char *)p + requested_size;
+            // blocks in a region of their own are counted through peak_mapped instead
+            if (heap_segment_contains(p, requested_size) &&
+                heap_segment_offset((char *)p + requested_size) > heap_end) {
+                heap_end = heap_segment_offset((char *)p + requested_size);
             }
         } else if (script->ops[req].op == REALLOC) {
             size_t old_size = script->blocks[id].size;
@@ -201,10 +403,11 @@ static size_t eval_correctness(script_t *script, bool quiet, bool *success) {
             }
 
             cur_size += (requested_size - old_size);
-            if ((char *)p + requested_size > (char *)heap_end) {
-                heap_end = (char *)p + requested_size;
+            if (heap_segment_contains(p, requested_size) &&
+                heap_segment_offset((char *)p + requested_size) > heap_end) {
+                heap_end = heap_segment_offset((char *)p + requested_size);
             }
-        } else if (script->ops[req].op == FREE) {
+        } else if (script->ops[req].op == FREE || script->ops[req].op == SIZED_FREE) {
             size_t old_size = script->blocks[id].size;
             void *p = script->blocks[id].ptr;
 
@@ -213,9 +416,33 @@ static size_t eval_correctness(script_t *script, bool quiet, bool *success) {
                 script->ops[req].lineno, "freeing")) {
                 return -1;
             }
-            script->blocks[id] = (block_t){.ptr = NULL, .size = 0};
-            myfree(p);
+            set_block(script, id, NULL, 0);
+            long start = start_timer(script);
+            if (script->ops[req].op == SIZED_FREE) {
+                myfree_sized(p, old_size);
+            } else {
+                myfree(p);
+            }
+            stop_timer(script, req, start);
             cur_size -= old_size;
+        } else if (script->ops[req].op == BATCH_ALLOC) {
+            bool fail = false;
+            size_t end = eval_malloc_batch(req, requested_size, script, &fail);
+            if (fail) {
+                return -1;
+            }
+
+            cur_size += script->ops[req].count * requested_size;
+            if (end > heap_end) {
+                heap_end = end;
+            }
+        } else if (script->ops[req].op == BATCH_FREE) {
+            bool fail = false;
+            size_t freed = eval_free_batch(req, script, &fail);
+            if (fail) {
+                return -1;
+            }
+            cur_size -= freed;
         }
 
         // check heap consistency after each request and stop if any error
@@ -228,23 +455,145 @@ static size_t eval_correctness(script_t *script, bool quiet, bool *success) {
         if (cur_size > script->peak_size) {
             script->peak_size = cur_size;
         }
+        if (heap_region_bytes() > script->peak_mapped) {
+            script->peak_mapped = heap_region_bytes();
+        }
     }
 
     // verify payload is still intact for any block still allocated
+    size_t live_blocks = 0;
     for (int id = 0; id < script->num_ids; id++) {
         if (!verify_payload(script->blocks[id].ptr, script->blocks[id].size, 
             id, script, -1, "at exit")) {
             return -1;
         }
+        if (script->blocks[id].ptr != NULL) {
+            live_blocks++;
+        }
+    }
+
+    // every block still in use must be counted by the allocator, which also counts blocks a script leaked
+    if (!quiet) {
+        allocator_stats_t stats = allocator_stats();
+        if (stats.mallocs - stats.frees < live_blocks || stats.allocated_bytes < cur_size) {
+            allocator_error(script, -1, "allocator_stats() counts %zu blocks of %zu bytes, but %zu blocks of %zu bytes are in use",
+                stats.mallocs - stats.frees, stats.allocated_bytes, live_blocks, cur_size);
+            return -1;
+        }
     }
 
     *success = true;
-    return (char *)heap_end - (char *)heap_segment_start();
+    return heap_end + script->peak_mapped;
+}
+
+/* Function: eval_throughput
+ * -------------------------
+ * Replays the requests of the script `reps` times in a tight loop, each
+ * time on a freshly initialized heap, and reports the requests per second
+ * and nanoseconds per request, over all repetitions and for the fastest
+ * one.  Nothing is verified or filled in, so the time is the allocator's
+ * own.  Setting up the heap is not timed.  Returns false, after reporting
+ * the request, if the allocator runs out of memory.
+ */
+static bool eval_throughput(script_t *script, int reps, bool huge_pages, bool small_heap) {
+    // batch requests need an array of pointers, which is set up before the clock starts
+    int max_count = 1;
+    for (int req = 0; req < script->num_ops; req++) {
+        if (script->ops[req].count > max_count) {
+            max_count = script->ops[req].count;
+        }
+    }
+    void **ptrs = malloc(max_count * sizeof(void *));
+    if (!ptrs) {
+        error(1, 0, "Libc heap exhausted. Cannot continue.");
+    }
+
+    size_t heap_size = small_heap ? SMALL_HEAP_SIZE : HEAP_SIZE;
+    long total_ns = 0;
+    long best_ns = 0;
+    for (int rep = 0; rep < reps; rep++) {
+        if (huge_pages) {
+            init_heap_segment_huge(heap_size);
+        } else {
+            reserve_heap_segment(heap_size);
+        }
+        if (!myinit(heap_segment_start(), heap_segment_size())) {
+            allocator_error(script, 0, "myinit() returned false");
+            free(ptrs);
+            return false;
+        }
+        memset(script->blocks, 0, script->num_ids * sizeof(block_t));
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int req = 0; req < script->num_ops; req++) {
+            request_t *op = &script->ops[req];
+            block_t *block = &script->blocks[op->id];
+            void *p = NULL;
+            if (op->op == ALLOC) {
+                p = mymalloc(op->size);
+            } else if (op->op == CALLOC) {
+                p = mycalloc(1, op->size);
+            } else if (op->op == ALIGNED_ALLOC) {
+                p = mymemalign(op->alignment, op->size);
+            } else if (op->op == REALLOC) {
+                p = myrealloc(block->ptr, op->size);
+            } else if (op->op == FREE) {
+                myfree(block->ptr);
+                *block = (block_t){.ptr = NULL, .size = 0};
+                continue;
+            } else if (op->op == SIZED_FREE) {
+                myfree_sized(block->ptr, block->size);
+                *block = (block_t){.ptr = NULL, .size = 0};
+                continue;
+            } else if (op->op == BATCH_ALLOC) {
+                if (mymalloc_batch(op->size, op->count, ptrs) < (size_t)op->count && op->size != 0) {
+                    allocator_error(script, op->lineno, "heap exhausted, batch malloc returned NULL");
+                    free(ptrs);
+                    return false;
+                }
+                for (int i = 0; i < op->count; i++) {
+                    block[i] = (block_t){.ptr = ptrs[i], .size = op->size};
+                }
+                continue;
+            } else {
+                for (int i = 0; i < op->count; i++) {
+                    ptrs[i] = block[i].ptr;
+                    block[i] = (block_t){.ptr = NULL, .size = 0};
+                }
+                myfree_batch(ptrs, op->count);
+                continue;
+            }
+            if (p == NULL && op->size != 0) {
+                allocator_error(script, op->lineno, "heap exhausted, malloc returned NULL");
+                free(ptrs);
+                return false;
+            }
+            *block = (block_t){.ptr = p, .size = op->size};
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        long ns = (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+        total_ns += ns;
+        if (rep == 0 || ns < best_ns) {
+            best_ns = ns;
+        }
+    }
+    free(ptrs);
+
+    double nops = (double)script->num_ops * reps;
+    printf("replayed %d requests %d times.", script->num_ops, reps);
+    printf("\n  throughput: %.2f Mops/sec, %.1f ns/op (fastest repetition %.1f ns/op)",
+        (total_ns > 0) ? nops * 1000.0 / total_ns : 0.0, total_ns / (nops > 0 ? nops : 1),
+        best_ns / (double)(script->num_ops > 0 ? script->num_ops : 1));
+    return true;
 }
 
 /* Function: eval_malloc
  * ---------------------
- * Performs a test of a call to mymalloc of the given size.  The req number
+ * Performs a test of a call to mymalloc of the given size, or to mymemalign
+ * for an aligned request, or to mycalloc for a calloc request, whose block
+ * must be all zero.  The req number
  * specifies the operation's index within the script.  This function verifies
  * the entire malloc'ed block and fills in the payload with a low-order byte
  * of the request id.  If the request fails, the boolean pointed to by
@@ -258,26 +607,62 @@ static void *eval_malloc(int req, size_t requested_size, script_t *script,
     int id = script->ops[req].id;
 
     void *p;
-    if ((p = mymalloc(requested_size)) == NULL && requested_size != 0) {
+    long start = start_timer(script);
+    if (script->ops[req].op == ALIGNED_ALLOC) {
+        p = mymemalign(script->ops[req].alignment, requested_size);
+    } else if (script->ops[req].op == CALLOC) {
+        p = mycalloc(1, requested_size);
+    } else {
+        p = mymalloc(requested_size);
+    }
+    stop_timer(script, req, start);
+    if (p == NULL && requested_size != 0) {
         allocator_error(script, script->ops[req].lineno, 
             "heap exhausted, malloc returned NULL");
         *failptr = true;
         return NULL;
     }
 
-    /* Test new block for correctness: must be properly aligned
-     * and must not overlap any currently allocated block.
+    /* The caller may use every byte up to the usable size the allocator
+     * reports, so that must be at least the requested size.
      */
-    if (!verify_block(p, requested_size, script, script->ops[req].lineno)) {
+    size_t usable_size = mymalloc_usable_size(p);
+    if (usable_size != 0 && usable_size < requested_size) {
+        allocator_error(script, script->ops[req].lineno,
+            "usable size %zu of new block (%p) is less than the %zu bytes requested",
+            usable_size, p, requested_size);
         *failptr = true;
         return NULL;
     }
+    size_t block_size = (usable_size > requested_size) ? usable_size : requested_size;
+
+    /* Test new block for correctness, including its usable bytes: must be
+     * properly aligned and must not overlap any currently allocated block.
+     */
+    if (!verify_block(p, block_size, script->ops[req].alignment, script, script->ops[req].lineno)) {
+        *failptr = true;
+        return NULL;
+    }
+
+    // a calloc'ed block must come back all zero
+    if (script->ops[req].op == CALLOC) {
+        for (size_t i = 0; i < requested_size; i++) {
+            if (((unsigned char *)p)[i] != 0) {
+                allocator_error(script, script->ops[req].lineno,
+                    "calloc'ed block (%p) is not zero at byte %zu", p, i);
+                *failptr = true;
+                return NULL;
+            }
+        }
+    }
 
     /* Fill new block with the low-order byte of new id
      * can be used later to verify data copied when realloc'ing.
+     * The usable bytes past the request are written too, to make
+     * sure the allocator keeps nothing there.
      */
-    memset(p, id & 0xFF, requested_size);
-    script->blocks[id] = (block_t){.ptr = p, .size = requested_size};
+    memset(p, id & 0xFF, block_size);
+    set_block(script, id, p, requested_size);
     *failptr = false;
     return p;
 }
@@ -306,15 +691,18 @@ static void *eval_realloc(int req, size_t requested_size, script_t *script,
     }
 
     void *newp;
-    if ((newp = myrealloc(oldp, requested_size)) == NULL && requested_size != 0) {
+    long start = start_timer(script);
+    newp = myrealloc(oldp, requested_size);
+    stop_timer(script, req, start);
+    if (newp == NULL && requested_size != 0) {
         allocator_error(script, script->ops[req].lineno, 
             "heap exhausted, realloc returned NULL");
         *failptr = true;
         return NULL;
     }
 
-    script->blocks[id].size = 0;
-    if (!verify_block(newp, requested_size, script, script->ops[req].lineno)) {
+    set_block(script, id, NULL, 0);
+    if (!verify_block(newp, requested_size, ALIGNMENT, script, script->ops[req].lineno)) {
         *failptr = true;
         return NULL;
     }
@@ -328,27 +716,122 @@ static void *eval_realloc(int req, size_t requested_size, script_t *script,
 
     // Fill new block with the low-order byte of new id
     memset(newp, id & 0xFF, requested_size);
-    script->blocks[id] = (block_t){.ptr = newp, .size = requested_size};
+    set_block(script, id, newp, requested_size);
 
     *failptr = false;
     return newp;
 }
 
+/* Function: eval_malloc_batch
+ * ---------------------------
+ * Performs a test of a call to mymalloc_batch for the blocks of a batch
+ * request, each of the given size, which get consecutive ids starting at
+ * the request's id.  Every block is verified and filled in like a block
+ * from eval_malloc, and the whole call is timed as one request.  If the
+ * request fails, the boolean pointed to by failptr is set to true -
+ * otherwise, it is set to false.  Returns the topmost segment offset used
+ * by the blocks in the heap segment, or 0 if there are none.
+ */
+static size_t eval_malloc_batch(int req, size_t requested_size, script_t *script,
+    bool *failptr) {
+
+    int first_id = script->ops[req].id;
+    int count = script->ops[req].count;
+    void **ptrs = malloc(count * sizeof(void *));
+    if (!ptrs) {
+        error(1, 0, "Libc heap exhausted. Cannot continue.");
+    }
+
+    long start = start_timer(script);
+    size_t nallocated = mymalloc_batch(requested_size, count, ptrs);
+    stop_timer(script, req, start);
+    if (nallocated < (size_t)count && requested_size != 0) {
+        allocator_error(script, script->ops[req].lineno,
+            "heap exhausted, batch malloc returned %zu of %d blocks", nallocated, count);
+        free(ptrs);
+        *failptr = true;
+        return 0;
+    }
+
+    size_t end = 0;
+    for (int i = 0; i < count; i++) {
+        int id = first_id + i;
+        void *p = ptrs[i];
+        if (!verify_block(p, requested_size, ALIGNMENT, script, script->ops[req].lineno)) {
+            free(ptrs);
+            *failptr = true;
+            return 0;
+        }
+        memset(p, id & 0xFF, requested_size);
+        set_block(script, id, p, requested_size);
+        if (heap_segment_contains(p, requested_size) &&
+            heap_segment_offset((char *)p + requested_size) > end) {
+            end = heap_segment_offset((char *)p + requested_size);
+        }
+    }
+
+    free(ptrs);
+    *failptr = false;
+    return end;
+}
+
+/* Function: eval_free_batch
+ * -------------------------
+ * Performs a test of a call to myfree_batch for the blocks with the
+ * consecutive ids of a batch request.  The payload of every block is
+ * verified before the call, and the whole call is timed as one request.
+ * If a payload is not intact, the boolean pointed to by failptr is set to
+ * true - otherwise, it is set to false.  Returns the number of payload
+ * bytes freed.
+ */
+static size_t eval_free_batch(int req, script_t *script, bool *failptr) {
+    int first_id = script->ops[req].id;
+    int count = script->ops[req].count;
+    void **ptrs = malloc(count * sizeof(void *));
+    if (!ptrs) {
+        error(1, 0, "Libc heap exhausted. Cannot continue.");
+    }
+
+    size_t freed = 0;
+    for (int i = 0; i < count; i++) {
+        int id = first_id + i;
+        if (!verify_payload(script->blocks[id].ptr, script->blocks[id].size, id,
+            script, script->ops[req].lineno, "batch freeing")) {
+            free(ptrs);
+            *failptr = true;
+            return 0;
+        }
+        ptrs[i] = script->blocks[id].ptr;
+        freed += script->blocks[id].size;
+        set_block(script, id, NULL, 0);
+    }
+
+    long start = start_timer(script);
+    myfree_batch(ptrs, count);
+    stop_timer(script, req, start);
+
+    free(ptrs);
+    *failptr = false;
+    return freed;
+}
+
 
 /* Function: verify_block
  * ----------------------
  * Does some checks on the block returned by allocator to try to
  * verify correctness.  If any problem shows up, reports an allocator error
  * with details and line from script file. The checks it performs are:
- *  -- verify block address is correctly aligned
+ *  -- verify block address is aligned to `alignment`, which is ALIGNMENT
+ *     unless the request asked for more
  *  -- verify block address is within heap segment
- *  -- verify block address + size doesn't overlap any existing allocated block
+ *  -- verify block address + size doesn't overlap any existing allocated block,
+ *     using the index of live blocks so the check takes O(log n) time
  */
-static bool verify_block(void *ptr, size_t size, script_t *script, int lineno) {
-    // address must be ALIGNMENT-byte aligned
-    if (((uintptr_t)ptr) % ALIGNMENT != 0) {
-        allocator_error(script, lineno, "New block (%p) not aligned to %d bytes",
-                        ptr, ALIGNMENT);
+static bool verify_block(void *ptr, size_t size, size_t alignment, script_t *script, int lineno) {
+    // address must be aligned as requested
+    if (((uintptr_t)ptr) % alignment != 0) {
+        allocator_error(script, lineno, "New block (%p) not aligned to %zu bytes",
+                        ptr, alignment);
         return false;
     }
 
@@ -356,29 +839,23 @@ static bool verify_block(void *ptr, size_t size, script_t *script, int lineno) {
         return true;
     }
 
-    // block must lie within the extent of the heap
+    // block must lie within the extent of the heap, in the segment or one of its chunks, or in a region of its own
     void *end = (char *)ptr + size;
-    void *heap_end = (char *)heap_segment_start() + heap_segment_size();
-    if (ptr < heap_segment_start() || end > heap_end) {
-        allocator_error(script, lineno, "New block (%p:%p) not within heap segment (%p:%p)",
-                        ptr, end, heap_segment_start(), heap_end);
+    if (!heap_segment_contains(ptr, size) && !heap_region_contains(ptr, size)) {
+        void *heap_end = (char *)heap_segment_start() + heap_segment_size();
+        allocator_error(script, lineno, "New block (%p:%p) not within heap segment (%p:%p), its %d added chunks or a region",
+                        ptr, end, heap_segment_start(), heap_end, heap_segment_chunks() - 1);
         return false;
     }
 
     // block must not overlap any other blocks
-    for (int i = 0; i < script->num_ids; i++) {
-        if (script->blocks[i].ptr == NULL || script->blocks[i].size == 0) {
-            continue;
-        }
-
-        void *other_start = script->blocks[i].ptr;
-        void *other_end = (char *)other_start + script->blocks[i].size;
-        if ((ptr >= other_start && ptr < other_end) || (end > other_start && end < other_end) ||
-            (ptr < other_start && end >= other_end)) {
-            allocator_error(script, lineno, "New block (%p:%p) overlaps existing block (%p:%p)",
-                            ptr, end, other_start, other_end);
-            return false;
-        }
+    int other = index_find_overlap(script, ptr, end);
+    if (other >= 0) {
+        void *other_start = script->blocks[other].ptr;
+        void *other_end = (char *)other_start + script->blocks[other].size;
+        allocator_error(script, lineno, "New block (%p:%p) overlaps existing block (%p:%p)",
+                        ptr, end, other_start, other_end);
+        return false;
     }
 
     return true;
@@ -403,6 +880,124 @@ static bool verify_payload(void *ptr, size_t size, int id, script_t *script,
     return true;
 }
 
+
+
+/* LIVE BLOCK INDEX IMPLEMENTATION */
+
+
+/* Function: set_block
+ * -------------------
+ * Records that the block with the given id is now at ptr with size bytes,
+ * or is not allocated if ptr is NULL, and keeps the index of live blocks up
+ * to date.  Blocks of size 0 can not overlap anything, so they are left out
+ * of the index.
+ */
+static void set_block(script_t *script, int id, void *ptr, size_t size) {
+    if (script->blocks[id].ptr != NULL && script->blocks[id].size != 0) {
+        script->index_root = index_remove(script, script->index_root, id);
+    }
+    script->blocks[id] = (block_t){.ptr = ptr, .size = size};
+    if (ptr != NULL && size != 0) {
+        script->index[id] = (index_node_t){.left = -1, .right = -1, .priority = script->index[id].priority};
+        script->index_root = index_insert(script, script->index_root, id);
+    }
+}
+
+/* Function: index_insert
+ * ----------------------
+ * Inserts the block with the given id into the subtree of the index rooted
+ * at root, and returns the new root of the subtree.  The block is added as
+ * a leaf by address, then rotated up past every ancestor with a lower
+ * priority.
+ */
+static int index_insert(script_t *script, int root, int id) {
+    if (root < 0) {
+        return id;
+    }
+    index_node_t *node = &script->index[root];
+    if ((uintptr_t)script->blocks[id].ptr < (uintptr_t)script->blocks[root].ptr) {
+        node->left = index_insert(script, node->left, id);
+        // rotate right if the new left child outranks its parent
+        if (script->index[node->left].priority > node->priority) {
+            int child = node->left;
+            node->left = script->index[child].right;
+            script->index[child].right = root;
+            return child;
+        }
+    } else {
+        node->right = index_insert(script, node->right, id);
+        // rotate left if the new right child outranks its parent
+        if (script->index[node->right].priority > node->priority) {
+            int child = node->right;
+            node->right = script->index[child].left;
+            script->index[child].left = root;
+            return child;
+        }
+    }
+    return root;
+}
+
+/* Function: index_remove
+ * ----------------------
+ * Removes the block with the given id, which must be in the subtree of the
+ * index rooted at root, and returns the new root of the subtree.  The block
+ * is rotated down toward its higher-priority child until it is a leaf, where
+ * it is cut off.
+ */
+static int index_remove(script_t *script, int root, int id) {
+    index_node_t *node = &script->index[root];
+    if (root != id) {
+        if ((uintptr_t)script->blocks[id].ptr < (uintptr_t)script->blocks[root].ptr) {
+            node->left = index_remove(script, node->left, id);
+        } else {
+            node->right = index_remove(script, node->right, id);
+        }
+        return root;
+    }
+    if (node->left < 0) {
+        return node->right;
+    }
+    if (node->right < 0) {
+        return node->left;
+    }
+    int child;
+    if (script->index[node->left].priority > script->index[node->right].priority) {
+        child = node->left;
+        node->left = script->index[child].right;
+        script->index[child].right = index_remove(script, root, id);
+    } else {
+        child = node->right;
+        node->right = script->index[child].left;
+        script->index[child].left = index_remove(script, root, id);
+    }
+    return child;
+}
+
+/* Function: index_find_overlap
+ * ----------------------------
+ * Returns the id of a live block that overlaps the bytes from start up to
+ * end, or -1 if there is none.  Live blocks do not overlap each other, so
+ * if any of them overlaps, the last block that starts before end does too,
+ * and it is the only one that has to be checked.
+ */
+static int index_find_overlap(script_t *script, void *start, void *end) {
+    int last_before = -1;  // block with the highest address below end seen so far
+    int cur = script->index_root;
+    while (cur >= 0) {
+        if ((uintptr_t)script->blocks[cur].ptr < (uintptr_t)end) {
+            last_before = cur;
+            cur = script->index[cur].right;
+        } else {
+            cur = script->index[cur].left;
+        }
+    }
+    if (last_before >= 0 &&
+        (uintptr_t)script->blocks[last_before].ptr + script->blocks[last_before].size > (uintptr_t)start) {
+        return last_before;
+    }
+    return -1;
+}
+
 /* Function: allocator_error
  * ------------------------
  * Report an error while running an allocator script.  Prints out the script
@@ -420,6 +1015,112 @@ static void allocator_error(script_t *script, int lineno, char* format, ...) {
 }
 
 
+/* LATENCY MEASUREMENT IMPLEMENTATION */
+
+
+/* Function: start_timer
+ * ---------------------
+ * Returns the current time in nanoseconds from a monotonic clock if the
+ * script is being timed, or 0 otherwise.  Pass the result to stop_timer
+ * right after the allocator call being measured.
+ */
+static long start_timer(script_t *script) {
+    if (script->latencies == NULL) {
+        return 0;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+/* Function: stop_timer
+ * --------------------
+ * If the script is being timed, records the nanoseconds since `start` as
+ * the latency of request number `req`.
+ */
+static void stop_timer(script_t *script, int req, long start) {
+    if (script->latencies == NULL) {
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    script->latencies[req] = now.tv_sec * 1000000000L + now.tv_nsec - start;
+}
+
+/* Function: compare_longs
+ * -----------------------
+ * Comparison function for qsort that orders longs from smallest to largest.
+ */
+static int compare_longs(const void *a, const void *b) {
+    long x = *(const long *)a;
+    long y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+/* Function: report_percentiles
+ * ----------------------------
+ * Prints the 50th, 99th and 99.9th percentile and the maximum of the n
+ * latencies, which must be sorted, on a line starting with `label`.
+ */
+static void report_percentiles(const char *label, long latencies[], int n) {
+    // smallest latency that at least the given per mille of requests are at or below
+    int p50 = (n * 500L + 999) / 1000 - 1;
+    int p99 = (n * 990L + 999) / 1000 - 1;
+    int p999 = (n * 999L + 999) / 1000 - 1;
+    printf("\n    %-12s %9d %9ld %9ld %9ld %9ld", label, n,
+        latencies[p50], latencies[p99], latencies[p999], latencies[n - 1]);
+}
+
+/* Function: report_latency
+ * ------------------------
+ * Prints the median, 99th and 99.9th percentile, and maximum latency in
+ * nanoseconds of the allocator calls made while running the script, for
+ * each type of request that the script makes and for all of them
+ * together.  The latencies are sorted in place.
+ */
+static void report_latency(script_t *script) {
+    if (script->num_ops == 0) {
+        return;
+    }
+    static const char *labels[] = {
+        [ALLOC] = "malloc", [FREE] = "free", [REALLOC] = "realloc", [BATCH_ALLOC] = "batch malloc",
+        [BATCH_FREE] = "batch free", [ALIGNED_ALLOC] = "memalign", [CALLOC] = "calloc",
+        [SIZED_FREE] = "sized free"
+    };
+    long *op_latencies = malloc(script->num_ops * sizeof(long));
+    if (!op_latencies) {
+        error(1, 0, "Libc heap exhausted. Cannot continue.");
+    }
+    printf("\n  latency (ns):     count       p50       p99     p99.9       max");
+    for (int type = ALLOC; type <= SIZED_FREE; type++) {
+        int n = 0;
+        for (int req = 0; req < script->num_ops; req++) {
+            if (script->ops[req].op == type) {
+                op_latencies[n++] = script->latencies[req];
+            }
+        }
+        if (n > 0) {
+            qsort(op_latencies, n, sizeof(long), compare_longs);
+            report_percentiles(labels[type], op_latencies, n);
+        }
+    }
+    free(op_latencies);
+    qsort(script->latencies, script->num_ops, sizeof(long), compare_longs);
+    report_percentiles("all", script->latencies, script->num_ops);
+}
+
+/* Function: report_stats
+ * ----------------------
+ * Prints the counters the allocator reported at the end of a script.
+ */
+static void report_stats(allocator_stats_t stats) {
+    printf("\n  stats: allocated = %zu, free = %zu in %zu blocks (largest %zu)",
+        stats.allocated_bytes, stats.free_bytes, stats.free_blocks, stats.largest_free);
+    printf("\n         mallocs = %zu, frees = %zu, reallocs = %zu, search steps = %zu",
+        stats.mallocs, stats.frees, stats.reallocs, stats.search_steps);
+}
+
+
 /* SCRIPT PARSING IMPLEMENTATION */
 
 
@@ -438,7 +1139,7 @@ static script_t parse_script(const char *path) {
     }
 
     // Initialize a script object to store the information about this script
-    script_t script = { .ops = NULL, .blocks = NULL, .num_ops = 0, .peak_size = 0};
+    script_t script = { .ops = NULL, .blocks = NULL, .index = NULL, .index_root = -1, .num_ops = 0, .peak_size = 0, .peak_mapped = 0, .latencies = NULL};
     const char *basename = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
     strncpy(script.name, basename, sizeof(script.name) - 1);
     script.name[sizeof(script.name) - 1] = '\0';
@@ -464,8 +1165,8 @@ static script_t parse_script(const char *path) {
 
         script.ops[i] = parse_script_line(buffer, lineno, script.name);
 
-        if (script.ops[i].id > maxid) {
-            maxid = script.ops[i].id;
+        if (script.ops[i].id + script.ops[i].count - 1 > maxid) {
+            maxid = script.ops[i].id + script.ops[i].count - 1;
         }
 
         script.num_ops = i + 1;
@@ -473,15 +1174,149 @@ static script_t parse_script(const char *path) {
 
     fclose(fp);
     script.num_ids = maxid + 1;
+    init_blocks(&script);
+    return script;
+}
+
+/* Function: init_blocks
+ * ---------------------
+ * Allocates the blocks array and the index nodes for the num_ids ids of the
+ * script, with no block allocated yet.
+ */
+static void init_blocks(script_t *script) {
+    int num_ids = script->num_ids;
+    script->num_ids = 0;
+    script->blocks = NULL;
+    script->index = NULL;
+    script->index_root = -1;
+    grow_blocks(script, num_ids);
+}
 
-    script.blocks = calloc(script.num_ids, sizeof(block_t));
-    if (!script.blocks) {
+/* Function: grow_blocks
+ * ---------------------
+ * Makes room in the blocks array and the index nodes for num_ids ids, none
+ * of which is allocated if it is new.  The index refers to blocks by id, so
+ * it stays valid when the arrays move.
+ */
+static void grow_blocks(script_t *script, int num_ids) {
+    block_t *blocks = realloc(script->blocks, (num_ids > 0 ? num_ids : 1) * sizeof(block_t));
+    index_node_t *index = realloc(script->index, (num_ids > 0 ? num_ids : 1) * sizeof(index_node_t));
+    if (!blocks || !index) {
         error(1, 0, "Libc heap exhausted. Cannot continue.");
     }
+    script->blocks = blocks;
+    script->index = index;
+    // each id gets a fixed pseudo-random priority, mixed from the id so runs are repeatable
+    for (int id = script->num_ids; id < num_ids; id++) {
+        unsigned x = (unsigned)id * 0x9E3779B9u;
+        x ^= x >> 16;
+        x *= 0x85EBCA6Bu;
+        x ^= x >> 13;
+        script->blocks[id] = (block_t){.ptr = NULL, .size = 0};
+        script->index[id] = (index_node_t){.left = -1, .right = -1, .priority = x};
+    }
+    script->num_ids = num_ids;
+}
+
+/* Function: free_script
+ * ---------------------
+ * Frees everything a script holds, unmapping its requests if they were
+ * loaded from a binary trace, or stopping its reader if it is streamed.
+ */
+static void free_script(script_t *script) {
+    if (script->stream != NULL) {
+        close_stream(script->stream);
+    } else if (script->mapped_size > 0) {
+        munmap((char *)script->ops - sizeof(trace_header_t), script->mapped_size);
+    } else {
+        free(script->ops);
+    }
+    free(script->blocks);
+    free(script->index);
+    free(script->latencies);
+}
+
+/* Function: load_script
+ * ---------------------
+ * Loads the script at the specified path, with map_trace if it is a binary
+ * trace, which starts with TRACE_MAGIC, or with parse_script otherwise.
+ */
+static script_t load_script(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        error(1, 0, "Could not open script file \"%s\".", path);
+    }
+    char magic[sizeof(((trace_header_t *)NULL)->magic)];
+    if (read(fd, magic, sizeof(magic)) == sizeof(magic) && memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0) {
+        return map_trace(path, fd);
+    }
+    close(fd);
+    return parse_script(path);
+}
+
+/* Function: map_trace
+ * -------------------
+ * Maps the binary trace open as fd, from the specified path, and returns a
+ * script whose ops are the records in the mapping, so nothing is parsed or
+ * copied.  The header must match this harness, and every record must pass
+ * valid_request with ids that fit in num_ids, or this function throws an
+ * error.  Checking
+ * the records reads in every page of the trace as it is loaded, which costs
+ * a pass over memory instead of a pass through the parser.  The file
+ * descriptor is closed.
+ */
+static script_t map_trace(const char *path, int fd) {
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(trace_header_t)) {
+        error(1, 0, "Binary trace \"%s\" is truncated.", path);
+    }
+    trace_header_t *header = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (header == MAP_FAILED) {
+        error(1, 0, "Could not map binary trace \"%s\".", path);
+    }
+    if (header->version != TRACE_VERSION || header->record_size != sizeof(request_t) ||
+        header->num_ops > INT32_MAX || header->num_ids > INT32_MAX ||
+        (size_t)st.st_size != sizeof(trace_header_t) + header->num_ops * sizeof(request_t)) {
+        error(1, 0, "Binary trace \"%s\" was not written by this harness or is truncated.", path);
+    }
+
+    script_t script = { .ops = (request_t *)(header + 1), .num_ops = header->num_ops, .num_ids = header->num_ids,
+                        .mapped_size = st.st_size };
+    const char *basename = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    strncpy(script.name, basename, sizeof(script.name) - 1);
+    script.name[sizeof(script.name) - 1] = '\0';
 
+    // records get the checks a parsed line gets, which is much cheaper than parsing them
+    for (int i = 0; i < script.num_ops; i++) {
+        if (!valid_request(&script.ops[i], script.num_ids)) {
+            error(1, 0, "Request %d of binary trace \"%s\" is malformed.", i, path);
+        }
+    }
+    init_blocks(&script);
     return script;
 }
 
+/* Function: write_trace
+ * ---------------------
+ * Writes the requests of the script to the specified path as a binary trace
+ * that map_trace can load.
+ */
+static void write_trace(script_t *script, const char *path) {
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) {
+        error(1, 0, "Could not create binary trace \"%s\".", path);
+    }
+    trace_header_t header = { .version = TRACE_VERSION, .record_size = sizeof(request_t),
+                              .num_ops = script->num_ops, .num_ids = script->num_ids };
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        fwrite(script->ops, sizeof(request_t), script->num_ops, fp) != (size_t)script->num_ops ||
+        fclose(fp) != 0) {
+        error(1, 0, "Could not write binary trace \"%s\".", path);
+    }
+}
+
 /* Function: read_line
  * --------------------
  * This function reads one line from the specified file and stores at most
@@ -520,29 +1355,254 @@ static bool read_line(char buffer[], size_t buffer_size, FILE *fp,
  * ---------------------------
  * This function parses the provided line from the script and returns info
  * about it as a request_t object filled in with the type of the request,
- * the size, the ID, and the line number.  If the line is malformed, this
- * function throws an error.
+ * the size, the ID, and the line number.  A calloc request, `c <id> <size>`,
+ * is written like an alloc request.  An aligned request, `m <id>
+ * <alignment> <size>`, also has the alignment, a power of two, that the
+ * block must start at; every other request uses ALIGNMENT.  A batch request, `A <id> <count>
+ * <size>` to allocate or `F <id> <count>` to free, also has the number of
+ * blocks, which use the ids from <id> on.  A sized free request, `s <id>`,
+ * frees the block like `f <id>` but through myfree_sized, with the size the
+ * block was last requested with, so like myfree_sized it is not for a block
+ * of an aligned request.  A single request has a count of 1.
+ * If the line is malformed, this function throws an error.
  */
 static request_t parse_script_line(char *buffer, int lineno, 
     char *script_name) {
 
-    request_t request = { .lineno = lineno, .op = 0, .size = 0};
+    request_t request = { .lineno = lineno, .op = 0, .count = 1, .size = 0, .alignment = ALIGNMENT};
 
     char request_char;
     int nscanned = sscanf(buffer, " %c %d %zu", &request_char, 
         &request.id, &request.size);
     if (request_char == 'a' && nscanned == 3) {
         request.op = ALLOC;
+    } else if (request_char == 'c' && nscanned == 3) {
+        request.op = CALLOC;
     } else if (request_char == 'r' && nscanned == 3) {
         request.op = REALLOC;
     } else if (request_char == 'f' && nscanned == 2) {
         request.op = FREE;
+    } else if (request_char == 's' && nscanned == 2) {
+        request.op = SIZED_FREE;
+    } else if (request_char == 'm') {
+        // aligned requests have the alignment between the id and the size
+        nscanned = sscanf(buffer, " %c %d %zu %zu", &request_char,
+            &request.id, &request.alignment, &request.size);
+        if (nscanned == 4 && request.alignment != 0 &&
+            (request.alignment & (request.alignment - 1)) == 0) {
+            request.op = ALIGNED_ALLOC;
+        }
+    } else if (request_char == 'A' || request_char == 'F') {
+        // batch requests have a count between the id and the size
+        nscanned = sscanf(buffer, " %c %d %d %zu", &request_char,
+            &request.id, &request.count, &request.size);
+        if (request_char == 'A' && nscanned == 4) {
+            request.op = BATCH_ALLOC;
+        } else if (request_char == 'F' && nscanned == 3) {
+            request.op = BATCH_FREE;
+        }
     }
 
-    if (!request.op || request.id < 0 || request.size > MAX_REQUEST_SIZE) {
+    if (!valid_request(&request, INT32_MAX)) {
         error(1, 0, "Line %d of script file '%s' is malformed.", 
             lineno, script_name);
     }
 
     return request;
 }
+
+/* Function: valid_request
+ * -----------------------
+ * Returns true if the request is one the replay can run: a known type, a
+ * size of at most MAX_REQUEST_SIZE, an alignment that is a power of two,
+ * and ids from request->id on that are below num_ids, with a count above 1
+ * only for a batch request.  Parsed lines, the records of a binary trace and
+ * the chunks of a streamed script are all checked with it, so a record that
+ * is not a parsed line can't reach the allocator or the checks of the replay.
+ */
+static bool valid_request(const request_t *request, int num_ids) {
+    bool batch = request->op == BATCH_ALLOC || request->op == BATCH_FREE;
+    return request->op >= ALLOC && request->op <= SIZED_FREE &&
+        request->size <= MAX_REQUEST_SIZE &&
+        request->alignment != 0 && (request->alignment & (request->alignment - 1)) == 0 &&
+        request->id >= 0 && request->count >= 1 && (batch || request->count == 1) &&
+        request->count <= num_ids - request->id;
+}
+
+
+/* SCRIPT STREAMING IMPLEMENTATION */
+
+
+/* Function: open_stream
+ * ---------------------
+ * Opens the text script or binary trace at the specified path to be replayed
+ * in chunks of STREAM_CHUNK_OPS requests, and starts a reader thread that
+ * reads the next chunk while the current one is replayed.  The script starts
+ * with no requests, and next_chunk hands them out.  Only the two chunks and
+ * the blocks of the ids seen so far, which must be below STREAM_MAX_IDS, are
+ * kept in memory.  This function throws
+ * an error if the file can't be opened or the header of a binary trace does
+ * not match this harness.
+ */
+static script_t open_stream(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        error(1, 0, "Could not open script file \"%s\".", path);
+    }
+    script_t script = { .num_ids = 1024 };
+    const char *basename = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    strncpy(script.name, basename, sizeof(script.name) - 1);
+    script.name[sizeof(script.name) - 1] = '\0';
+
+    stream_t *stream = calloc(1, sizeof(stream_t));
+    if (!stream) {
+        error(1, 0, "Libc heap exhausted. Cannot continue.");
+    }
+    stream->fp = fp;
+    strcpy(stream->name, script.name);
+    // a binary trace tells how many ids it has, the blocks of a text script grow as its ids are seen
+    trace_header_t header;
+    if (fread(&header, sizeof(header), 1, fp) == 1 && memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) == 0) {
+        if (header.version != TRACE_VERSION || header.record_size != sizeof(request_t) ||
+            header.num_ids > INT32_MAX) {
+            error(1, 0, "Binary trace \"%s\" was not written by this harness.", path);
+        }
+        if (header.num_ids > STREAM_MAX_IDS) {
+            error(1, 0, "Binary trace \"%s\" has %lu ids, more than the %d a streamed script can have.",
+                path, (unsigned long)header.num_ids, STREAM_MAX_IDS);
+        }
+        stream->binary = true;
+        script.num_ids = header.num_ids;
+    } else {
+        rewind(fp);
+    }
+    for (int i = 0; i < 2; i++) {
+        stream->chunks[i] = malloc(STREAM_CHUNK_OPS * sizeof(request_t));
+        if (!stream->chunks[i]) {
+            error(1, 0, "Libc heap exhausted. Cannot continue.");
+        }
+    }
+    pthread_mutex_init(&stream->lock, NULL);
+    pthread_cond_init(&stream->changed, NULL);
+    if (pthread_create(&stream->reader, NULL, read_stream, stream) != 0) {
+        error(1, 0, "Could not start a thread to read \"%s\".", path);
+    }
+
+    script.stream = stream;
+    init_blocks(&script);
+    return script;
+}
+
+/* Function: read_stream
+ * ---------------------
+ * The reader thread of a streamed script.  It fills the two chunks in turn,
+ * each once the replay has given it back, until the script ends, which it
+ * marks with a chunk of 0 requests, or until the replay stops early.  Lines
+ * of a text script are parsed with parse_script_line.
+ */
+static void *read_stream(void *arg) {
+    stream_t *stream = arg;
+    char buffer[MAX_SCRIPT_LINE_LEN];
+    for (int i = 0; ; i ^= 1) {
+        pthread_mutex_lock(&stream->lock);
+        while (stream->filled[i] && !stream->stop) {
+            pthread_cond_wait(&stream->changed, &stream->lock);
+        }
+        bool stop = stream->stop;
+        pthread_mutex_unlock(&stream->lock);
+        if (stop) {
+            return NULL;
+        }
+
+        // the chunk is read without the lock, while the replay works on the other one
+        int count = 0;
+        if (stream->binary) {
+            count = fread(stream->chunks[i], sizeof(request_t), STREAM_CHUNK_OPS, stream->fp);
+        } else {
+            while (count < STREAM_CHUNK_OPS && read_line(buffer, sizeof(buffer), stream->fp, &stream->lineno)) {
+                stream->chunks[i][count++] = parse_script_line(buffer, stream->lineno, stream->name);
+            }
+        }
+
+        pthread_mutex_lock(&stream->lock);
+        stream->counts[i] = count;
+        stream->filled[i] = true;
+        pthread_cond_broadcast(&stream->changed);
+        pthread_mutex_unlock(&stream->lock);
+        if (count == 0) {
+            return NULL;
+        }
+    }
+}
+
+/* Function: next_chunk
+ * --------------------
+ * Called by the replay when it has run every request of script->ops.  For a
+ * streamed script, gives the chunk that was replayed back to the reader,
+ * waits for the next one, makes it script->ops, makes room for its ids and
+ * sets the request number pointed to by `preq` to 0.  Returns false once
+ * there are no more requests, which for a script that is not streamed is
+ * right away.
+ */
+static bool next_chunk(script_t *script, int *preq) {
+    stream_t *stream = script->stream;
+    if (stream == NULL) {
+        script->total_ops = script->num_ops;
+        return false;
+    }
+    pthread_mutex_lock(&stream->lock);
+    // the chunk just replayed, if there was one, can be read into again
+    if (script->ops != NULL) {
+        stream->filled[stream->next ^ 1] = false;
+        pthread_cond_broadcast(&stream->changed);
+    }
+    while (!stream->filled[stream->next]) {
+        pthread_cond_wait(&stream->changed, &stream->lock);
+    }
+    script->ops = stream->chunks[stream->next];
+    script->num_ops = stream->counts[stream->next];
+    stream->next ^= 1;
+    pthread_mutex_unlock(&stream->lock);
+
+    // check the records of a binary trace with valid_request, and grow the blocks for ids that are new
+    int maxid = -1;
+    for (int req = 0; req < script->num_ops; req++) {
+        request_t *request = &script->ops[req];
+        if (!valid_request(request, INT32_MAX)) {
+            error(1, 0, "Request %ld of script file \"%s\" is malformed.", script->total_ops + req, script->name);
+        }
+        if (request->id + request->count - 1 > maxid) {
+            maxid = request->id + request->count - 1;
+        }
+        if (maxid >= STREAM_MAX_IDS) {
+            error(1, 0, "Request %ld of script file \"%s\" uses id %d, but a streamed script can only use ids below %d.",
+                script->total_ops + req, script->name, maxid, STREAM_MAX_IDS);
+        }
+    }
+    if (maxid >= script->num_ids) {
+        int num_ids = (maxid + 1 > 2 * script->num_ids) ? maxid + 1 : 2 * script->num_ids;
+        grow_blocks(script, (num_ids < STREAM_MAX_IDS) ? num_ids : STREAM_MAX_IDS);
+    }
+    script->total_ops += script->num_ops;
+    *preq = 0;
+    return script->num_ops > 0;
+}
+
+/* Function: close_stream
+ * ----------------------
+ * Stops the reader thread of a streamed script, waits for it to finish, and
+ * frees the stream.
+ */
+static void close_stream(stream_t *stream) {
+    pthread_mutex_lock(&stream->lock);
+    stream->stop = true;
+    pthread_cond_broadcast(&stream->changed);
+    pthread_mutex_unlock(&stream->lock);
+    pthread_join(stream->reader, NULL);
+    pthread_mutex_destroy(&stream->lock);
+    pthread_cond_destroy(&stream->changed);
+    fclose(stream->fp);
+    free(stream->chunks[0]);
+    free(stream->chunks[1]);
+    free(stream);
+}
@@ -0,0 +1,124 @@
+/* File: thread_bench.c
+ * --------------------
+ * A multi-threaded throughput benchmark for the THREAD_SAFE build of the
+ * explicit allocator.  Each thread repeatedly allocates and frees small
+ * blocks of random sizes in its own array of slots.  The benchmark is run
+ * with 1, 2, ... up to the requested number of threads, and reports the
+ * total throughput and the speedup over a single thread for each count.
+ *
+ * Usage: thread_bench [max_threads] [ops_per_thread]
+ * max_threads defaults to the number of online cores.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "allocator.h"
+#include "segment.h"
+
+#define HEAP_SIZE (1L << 32)
+
+// number of live blocks each thread juggles
+#define SLOTS_PER_THREAD 1024
+
+// largest request size used by the benchmark
+#define MAX_BENCH_SIZE 256
+
+const long DEFAULT_OPS_PER_THREAD = 2000000;
+
+// struct for the arguments of one benchmark thread
+typedef struct {
+    long nops;          // number of malloc/free calls to make
+    unsigned int seed;  // seed for this thread's random sizes
+} worker_t;
+
+
+/* Function: worker
+ * ----------------
+ * The body of one benchmark thread.  Each operation picks a random slot,
+ * frees the block in it if there is one, and otherwise fills it with a new
+ * block of random size, touching the first byte so the block is really used.
+ * All blocks still held are freed at the end.
+ */
+static void *worker(void *arg) {
+    worker_t *w = arg;
+    void *slots[SLOTS_PER_THREAD] = {NULL};
+
+    for (long i = 0; i < w->nops; i++) {
+        int slot = rand_r(&w->seed) % SLOTS_PER_THREAD;
+        if (slots[slot] != NULL) {
+            myfree(slots[slot]);
+            slots[slot] = NULL;
+        } else {
+            size_t size = 1 + rand_r(&w->seed) % MAX_BENCH_SIZE;
+            slots[slot] = mymalloc(size);
+            if (slots[slot] != NULL) {
+                *(char *)slots[slot] = 1;
+            }
+        }
+    }
+    for (int slot = 0; slot < SLOTS_PER_THREAD; slot++) {
+        myfree(slots[slot]);
+    }
+    return NULL;
+}
+
+/* Function: run
+ * -------------
+ * Resets the heap, runs nthreads worker threads that each make nops calls,
+ * and returns the elapsed wall-clock time in seconds.
+ */
+static double run(int nthreads, long nops) {
+    if (!myinit(heap_segment_start(), heap_segment_size())) {
+        fprintf(stderr, "myinit() returned false\n");
+        exit(1);
+    }
+    // every run starts from the segment alone, without the chunks the heap grew in the run before
+    if (heap_segment_chunks() != 1) {
+        fprintf(stderr, "myinit() kept %d chunks of the last heap\n", heap_segment_chunks() - 1);
+        exit(1);
+    }
+
+    pthread_t threads[nthreads];
+    worker_t args[nthreads];
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < nthreads; i++) {
+        args[i] = (worker_t){.nops = nops, .seed = i + 1};
+        pthread_create(&threads[i], NULL, worker, &args[i]);
+    }
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (!validate_heap()) {
+        fprintf(stderr, "validate_heap() returned false after %d threads\n", nthreads);
+        exit(1);
+    }
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    int max_threads = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+    long nops = argc > 2 ? atol(argv[2]) : DEFAULT_OPS_PER_THREAD;
+    if (max_threads < 1 || nops < 1) {
+        fprintf(stderr, "Usage: %s [max_threads] [ops_per_thread]\n", argv[0]);
+        return 1;
+    }
+
+    reserve_heap_segment(HEAP_SIZE);
+    printf("%8s %14s %10s\n", "threads", "Mops/sec", "speedup");
+    double base_rate = 0;
+    for (int nthreads = 1; nthreads <= max_threads; nthreads++) {
+        double secs = run(nthreads, nops);
+        double rate = nthreads * nops / secs;
+        if (nthreads == 1) {
+            base_rate = rate;
+        }
+        printf("%8d %14.2f %9.2fx\n", nthreads, rate / 1e6, rate / base_rate);
+    }
+    return 0;
+}
@@ -0,0 +1,598 @@
+/* CS 107
+Code written by: Christo Hristov
+
+This file contains a series of utility functions implemented to allocate, free, and reallocate memory from a heap using two-level segregated fit (TLSF).  These functions are used in the test_tlsf.c file.
+
+Free blocks are kept in a two-level array of free lists.  The first level splits sizes by power of two, and the second level splits each power of two into SL_COUNT equal ranges.  A bitmap of non-empty lists for each level lets mymalloc find a list whose blocks all fit the request with two find-first-set instructions, and every free block has a footer, so myfree can coalesce with both neighbours directly.  No operation ever walks a list or the heap, so mymalloc and myfree take a bounded amount of time no matter how fragmented the heap is.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "./allocator.h"
+#include "./debug_break.h"
+
+#define BLOCK_SIZE 8  // define a constant to hold the number of bytes in a header
+#define MIN_BLOCK 24  // smallest payload, enough for a free list node and a footer
+#define USED_BIT 1  // bit of the header that is set when the block is used
+#define PREV_FREE_BIT 2  // bit of the header that is set when the block before it in the heap is free
+#define SIZE_MASK (~(size_t)(ALIGNMENT - 1))  // mask that clears the status bits of a header
+#define SL_LOG 5  // log2 of the number of second-level lists per first-level range
+#define SL_COUNT (1 << SL_LOG)  // number of second-level lists per first-level range
+#define SMALL_LOG 8  // log2 of SMALL_SIZE
+#define SMALL_SIZE (1 << SMALL_LOG)  // sizes below this all share first-level list 0, in steps of ALIGNMENT
+#define FL_COUNT 33  // number of first-level ranges, the last one holds sizes up to 2^40
+
+static void *segment_start;
+static size_t segment_size;
+static void *free_lists[FL_COUNT][SL_COUNT];  // first node of each free list, or NULL if the list is empty
+static unsigned long fl_bitmap;  // bit i is set if some list of first level i is non-empty
+static unsigned int sl_bitmaps[FL_COUNT];  // bit j of sl_bitmaps[i] is set if free_lists[i][j] is non-empty
+static allocator_stats_t stats;  // counters returned by allocator_stats, largest_free is filled in when asked
+
+// create a struct, header, to hold the size of the block of memory indicated by the header
+typedef struct {
+    size_t size;  // payload size, with the status bits in the low bits
+} header;
+
+// a free block stores its payload size in a footer in the last bytes of its payload
+typedef struct {
+    size_t size;
+} footer;
+
+// create a struct to hold a node in a free linked list
+typedef struct {
+    void *next;  // pointer to next node in list
+    void *prev;  // pointer to previous node in list
+} node;
+
+/* Function: roundup
+----------------------------
+Given an amount, sz, and a mulitplier, mult, roundup returns the smallest number that is a multiple of mult and is larger or equal to sz.
+*/
+
+size_t roundup(size_t sz, size_t mult) {
+    return (sz + mult - 1) & ~(mult - 1);
+}
+
+/* Function: get_size
+-------------------------------
+Given a void pointer, headerptr, get_size returns the number of payload bytes in the block indicated by the header.
+*/
+
+size_t get_size(void *headerptr) {
+    return ((header *)headerptr)->size & SIZE_MASK;
+}
+
+/* Function: is_free
+-------------------------------
+Given a void pointer, headerptr, is_free returns true if headerptr points to a header that indicates a free block, and false otherwise.
+*/
+
+bool is_free(void *headerptr) {
+    return (((header *)headerptr)->size & USED_BIT) == 0;
+}
+
+/* Function: prev_is_free
+-------------------------------
+Given a void pointer, headerptr, prev_is_free returns true if the header records that the block right before it in the heap is free.
+*/
+
+bool prev_is_free(void *headerptr) {
+    return (((header *)headerptr)->size & PREV_FREE_BIT) != 0;
+}
+
+/* Function: set_prev_free
+-------------------------------
+Given a pointer to the end of a block, next_location, and whether that block is free, prev_free, set_prev_free updates the header of the block that starts at next_location.  Nothing is updated if next_location is the end of the heap.
+*/
+
+void set_prev_free(void *next_location, bool prev_free) {
+    if (next_location >= (void *)((char *)segment_start + segment_size)) {
+        return;
+    }
+    header *next_header = (header *)next_location;
+    if (prev_free) {
+        next_header->size |= PREV_FREE_BIT;
+    } else {
+        next_header->size &= ~(size_t)PREV_FREE_BIT;
+    }
+}
+
+/* Function: mapping
+-------------------------------
+Given a payload size, size, mapping stores the first-level and second-level indexes of the free list that holds blocks of that size in fl and sl.
+*/
+
+void mapping(size_t size, int *fl, int *sl) {
+    if (size < SMALL_SIZE) {
+        *fl = 0;
+        *sl = size / (SMALL_SIZE / SL_COUNT);
+    } else {
+        int log = 63 - __builtin_clzl(size);  // index of the highest set bit of size
+        *sl = (size >> (log - SL_LOG)) ^ SL_COUNT;  // the SL_LOG bits below the highest bit
+        *fl = log - SMALL_LOG + 1;
+        // every size too big for the last range shares its last list
+        if (*fl >= FL_COUNT) {
+            *fl = FL_COUNT - 1;
+            *sl = SL_COUNT - 1;
+        }
+    }
+}
+
+/* Function: make_free
+----------------------------------
+Given a pointer to where we want a free block, location, and a size of the free block, space, make_free will make a free block at location with its footer, push it onto the front of the free list for its size, count it in stats, and mark the following block as having a free block before it.
+
+This function assumes that the block before location is not free.
+*/
+
+void make_free(void *location, size_t space) {
+    ((header *)location)->size = space;
+    ((footer *)((char *)location + space))->size = space;
+    set_prev_free((char *)location + BLOCK_SIZE + space, true);
+    int fl, sl;
+    mapping(space, &fl, &sl);
+    node *new_node = (node *)((char *)location + BLOCK_SIZE);
+    new_node->next = free_lists[fl][sl];
+    new_node->prev = NULL;
+    if (free_lists[fl][sl] != NULL) {
+        ((node *)free_lists[fl][sl])->prev = new_node;
+    }
+    free_lists[fl][sl] = new_node;
+    fl_bitmap |= 1UL << fl;
+    sl_bitmaps[fl] |= 1U << sl;
+    stats.free_blocks++;
+    stats.free_bytes += space;
+}
+
+/* Function: remove_free
+------------------------------
+Given a pointer to the header of a free block, location, remove_free will remove the block from its free list, clearing the bitmap bits of any list or level that becomes empty, and stop counting it in stats.
+*/
+
+void remove_free(void *location) {
+    int fl, sl;
+    mapping(get_size(location), &fl, &sl);
+    node *cur = (node *)((char *)location + BLOCK_SIZE);
+    node *next_block = (node *)(cur->next);
+    node *prev_block = (node *)(cur->prev);
+    if (prev_block != NULL) {
+        prev_block->next = next_block;
+    } else {
+        free_lists[fl][sl] = next_block;
+        if (next_block == NULL) {
+            sl_bitmaps[fl] &= ~(1U << sl);
+            if (sl_bitmaps[fl] == 0) {
+                fl_bitmap &= ~(1UL << fl);
+            }
+        }
+    }
+    if (next_block != NULL) {
+        next_block->prev = prev_block;
+    }
+    stats.free_blocks--;
+    stats.free_bytes -= get_size(location);
+}
+
+/* Function: make_used
+-----------------------------
+Given a pointer to a header, location, and a size, allocated_size, make_used will change the header to indicate a used block of that size, keeping its PREV_FREE_BIT, and mark the following block as having a used block before it.
+*/
+
+void make_used(void *location, size_t allocated_size) {
+    header *headerptr = (header *)location;
+    headerptr->size = allocated_size | USED_BIT | (headerptr->size & PREV_FREE_BIT);
+    set_prev_free((char *)location + BLOCK_SIZE + allocated_size, false);
+}
+
+/* Function: split_used
+--------------------------------
+Given a pointer to the header of a block that is not on any free list, location, the total payload bytes available to it, space, and the payload bytes it needs, needed, split_used makes the block used with needed bytes and turns any leftover bytes into a free block.
+
+This function assumes that needed <= space and that the block after the space is used.
+*/
+
+void split_used(void *location, size_t space, size_t needed) {
+    if (space >= needed + BLOCK_SIZE + MIN_BLOCK) {
+        make_used(location, needed);
+        make_free((char *)location + BLOCK_SIZE + needed, space - needed - BLOCK_SIZE);
+    } else {
+        make_used(location, space);
+    }
+}
+
+/* Function: coalesce
+--------------------------------
+Given a pointer to a block that is not on any free list, location, and its payload size, space, coalesce will merge the block with the free blocks right before and right after it, if there are any, and add the resulting free block to the free lists.
+*/
+
+void coalesce(void *location, size_t space) {
+    void *next_location = (char *)location + BLOCK_SIZE + space;
+    if (next_location < (void *)((char *)segment_start + segment_size) && is_free(next_location)) {
+        remove_free(next_location);
+        space += BLOCK_SIZE + get_size(next_location);
+    }
+    if (prev_is_free(location)) {
+        size_t prev_space = ((footer *)((char *)location - BLOCK_SIZE))->size;
+        location = (char *)location - BLOCK_SIZE - prev_space;
+        remove_free(location);
+        space += BLOCK_SIZE + prev_space;
+    }
+    make_free(location, space);
+}
+
+/* Function: find_free
+--------------------------------
+Given an alligned number of bytes, needed, find_free returns the header of a free block with at least needed bytes, or NULL if there is none.  The size is first rounded up to the next list boundary, so every block of the list it maps to, and of every larger list, fits.  The bitmaps then give the first non-empty list at or above it in constant time.
+*/
+
+void *find_free(size_t needed) {
+    // round up so that every block in the list we start at is big enough
+    if (needed >= SMALL_SIZE) {
+        int log = 63 - __builtin_clzl(needed);
+        needed += ((size_t)1 << (log - SL_LOG)) - 1;
+    }
+    int fl, sl;
+    mapping(needed, &fl, &sl);
+    unsigned int sl_map = sl_bitmaps[fl] & (~0U << sl);  // lists of this level that are big enough
+    if (sl_map == 0) {
+        // use the smallest list of the next non-empty level
+        if (fl + 1 >= FL_COUNT) {
+            return NULL;
+        }
+        unsigned long fl_map = fl_bitmap & (~0UL << (fl + 1));
+        if (fl_map == 0) {
+            return NULL;
+        }
+        fl = __builtin_ctzl(fl_map);
+        sl_map = sl_bitmaps[fl];
+    }
+    sl = __builtin_ctz(sl_map);
+    return (char *)free_lists[fl][sl] - BLOCK_SIZE;
+}
+
+/* Function: myinit
+------------------------------
+Given a pointer to the start of the heap, heap_start, and the size of the heap, heap_size, myinit intializes heap_size bytes of memory starting at heap_start to be used as the heap, as one free block.  Subsequent calls to myinit will clear the current heap.  myinit will return false if the heap is too small to hold a free block, and otherwise will return true.
+
+This function assumes that heap_start is a non null pointer that is alligned with the ALIGNMENT constant, and that heap_size is a multiple of ALIGNMENT.
+*/
+
+bool myinit(void *heap_start, size_t heap_size) {
+    if (heap_size < BLOCK_SIZE + MIN_BLOCK) {
+        return false;
+    }
+    segment_start = heap_start;
+    segment_size = heap_size;
+    memset(free_lists, 0, sizeof(free_lists));
+    memset(sl_bitmaps, 0, sizeof(sl_bitmaps));
+    fl_bitmap = 0;
+    memset(&stats, 0, sizeof(stats));
+    make_free(segment_start, segment_size - BLOCK_SIZE);
+    return true;
+}
+
+/* Function: mymalloc
+--------------------------
+Given a number of bytes, requested_size, mymalloc will return a pointer to an adress in the heap that contains an alligned requested_size number of bytes to be used by the caller, taking a bounded amount of time.  If the requested_size is 0 or there is not enough free memory in the heap to accomodate the user's request, mymalloc will return a null pointer.  If the user inputs a size less than MIN_BLOCK, mymalloc will allocate MIN_BLOCK number of bytes.
+*/
+
+void *mymalloc(size_t requested_size) {
+    if (requested_size == 0 || requested_size > MAX_REQUEST_SIZE) {
+        return NULL;
+    }
+    if (requested_size < MIN_BLOCK) {
+        requested_size = MIN_BLOCK;
+    }
+    size_t needed = roundup(requested_size, ALIGNMENT);
+    void *location = find_free(needed);
+    if (location == NULL) {
+        return NULL;
+    }
+    remove_free(location);
+    split_used(location, get_size(location), needed);
+    stats.mallocs++;
+    stats.allocated_bytes += get_size(location);
+    return (char *)location + BLOCK_SIZE;
+}
+
+/* Function: mycalloc
+------------------------------------
+Given a number of elements, nmemb, and the size of each, size, mycalloc returns a pointer to a block of nmemb * size bytes that are all zero, or NULL if the product is 0, too big or does not fit in the heap.  Free blocks do not record whether they are zero, so the block is cleared with memset.
+*/
+
+void *mycalloc(size_t nmemb, size_t size) {
+    if (nmemb == 0 || size == 0 || nmemb > MAX_REQUEST_SIZE / size) {
+        return NULL;
+    }
+    void *result = mymalloc(nmemb * size);
+    if (result != NULL) {
+        memset(result, 0, nmemb * size);
+    }
+    return result;
+}
+
+/* Function: mymemalign
+--------------------------
+Given a power of two, alignment, and a number of bytes, requested_size, mymemalign returns a pointer to a block of requested_size bytes that starts at a multiple of alignment.  It takes a free block big enough to hold the payload after any gap needed to reach the alignment, and the gap becomes a free block of its own instead of being wasted.  A gap must have room for a header and a payload of at least MIN_BLOCK bytes, so the payload moves up by the alignment until the gap is that big.  Alignments of at most ALIGNMENT are met by every block, so those requests are passed to mymalloc.  mymemalign returns NULL if requested_size is 0, alignment is not a power of two, or there is not enough free memory.
+*/
+
+void *mymemalign(size_t alignment, size_t requested_size) {
+    if (requested_size == 0 || requested_size > MAX_REQUEST_SIZE || alignment > MAX_REQUEST_SIZE ||
+        (alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+    if (alignment <= ALIGNMENT) {
+        return mymalloc(requested_size);
+    }
+    if (requested_size < MIN_BLOCK) {
+        requested_size = MIN_BLOCK;
+    }
+    size_t needed = roundup(requested_size, ALIGNMENT);
+    // a block this big can always fit the payload after a gap big enough to be a free block
+    void *location = find_free(needed + alignment + BLOCK_SIZE + MIN_BLOCK);
+    if (location == NULL) {
+        return NULL;
+    }
+    remove_free(location);
+    size_t space = get_size(location);
+    char *payload = (char *)location + BLOCK_SIZE;
+    char *aligned = (char *)roundup((size_t)payload, alignment);
+    while (aligned != payload && aligned - payload < BLOCK_SIZE + MIN_BLOCK) {
+        aligned += alignment;
+    }
+    if (aligned != payload) {
+        // the rest of the block after the gap gets its header first, so make_free can mark it
+        space -= aligned - payload;
+        ((header *)(aligned - BLOCK_SIZE))->size = space;
+        make_free(location, aligned - payload - BLOCK_SIZE);
+        location = aligned - BLOCK_SIZE;
+    }
+    split_used(location, space, needed);
+    stats.mallocs++;
+    stats.allocated_bytes += get_size(location);
+    return aligned;
+}
+
+/* Function: myfree
+-----------------------------
+Given a pointer to the heap, ptr, myfree will free the memory pointed to by the pointer, merging it with the free blocks right before and after it, in a bounded amount of time.  myfree will do nothing if given a NULL pointer.
+
+This function assumes ptr points to the first address of a previously allocated block.
+*/
+
+void myfree(void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    void *location = (char *)ptr - BLOCK_SIZE;
+    stats.frees++;
+    stats.allocated_bytes -= get_size(location);
+    coalesce(location, get_size(location));
+}
+
+/* Function: myrealloc
+-----------------------------
+Given a pointer to the heap, old_ptr, and a size, new_size, myrealloc will return a pointer to new_size bytes holding the memory from old_ptr.  The block is resized in place if it and a free block following it have enough space, and otherwise the memory is moved to a new block and old_ptr is freed.  If there is not enough space in the heap, myrealloc will not free old_ptr and returns NULL.  If old_ptr is NULL, myrealloc behaves like mymalloc, and if new_size is zero, it behaves like myfree.
+
+This function assumes that old_ptr points to the beggining of a previously allocated block of memory.
+*/
+
+void *myrealloc(void *old_ptr, size_t new_size) {
+    if (old_ptr == NULL) {
+        return mymalloc(new_size);
+    }
+    if (new_size == 0) {
+        myfree(old_ptr);
+        return NULL;
+    }
+    if (new_size > MAX_REQUEST_SIZE) {
+        return NULL;
+    }
+    if (new_size < MIN_BLOCK) {
+        new_size = MIN_BLOCK;
+    }
+    size_t needed = roundup(new_size, ALIGNMENT);
+    void *location = (char *)old_ptr - BLOCK_SIZE;
+    size_t old_size = get_size(location);
+    size_t space = old_size;
+    void *next_location = (char *)location + BLOCK_SIZE + old_size;
+    bool next_free = next_location < (void *)((char *)segment_start + segment_size) && is_free(next_location);
+    if (next_free) {
+        space += BLOCK_SIZE + get_size(next_location);
+    }
+    // if there is enough space for inplace realloc
+    if (needed <= space) {
+        if (next_free) {
+            remove_free(next_location);
+        }
+        split_used(location, space, needed);
+        stats.reallocs++;
+        stats.allocated_bytes += get_size(location) - old_size;
+        return old_ptr;
+    }
+    void *result = mymalloc(new_size);
+    if (result == NULL) {
+        return NULL;
+    }
+    memcpy(result, old_ptr, old_size);
+    myfree(old_ptr);
+    stats.reallocs++;
+    return result;
+}
+
+/* Function: myfree_sized
+-----------------------------
+Given a pointer to the heap, ptr, and the size it was requested with, size, myfree_sized frees the block like myfree.  The merge with the block before needs the bit in the header anyway, and the block can be bigger than size, so the size is still read from the header.
+*/
+
+void myfree_sized(void *ptr, size_t size) {
+    myfree(ptr);
+}
+
+/* Function: mymalloc_usable_size
+-----------------------------
+Given a pointer to an allocated block, ptr, mymalloc_usable_size returns the number of bytes the caller can use at ptr, which is the payload size in its header.  It can be more than was requested, because sizes are rounded up to ALIGNMENT and MIN_BLOCK and leftover space too small to split off stays in the block.  It returns 0 if ptr is NULL.
+*/
+
+size_t mymalloc_usable_size(void *ptr) {
+    if (ptr == NULL) {
+        return 0;
+    }
+    return get_size((char *)ptr - BLOCK_SIZE);
+}
+
+/* Function: mymalloc_batch
+------------------------------------
+Given a number of bytes, size, a number of blocks, count, and an array, out, mymalloc_batch allocates count blocks of size bytes and stores pointers to them in out.  A TLSF search already takes bounded time, so each block is allocated with mymalloc.  It returns the number of blocks allocated, and the entries of out after the last one are set to NULL.
+*/
+
+size_t mymalloc_batch(size_t size, size_t count, void *out[]) {
+    size_t done = 0;
+    while (done < count && (out[done] = mymalloc(size)) != NULL) {
+        done++;
+    }
+    for (size_t i = done; i < count; i++) {
+        out[i] = NULL;
+    }
+    return done;
+}
+
+/* Function: myfree_batch
+------------------------------------
+Given an array of pointers to the heap, ptrs, and its length, count, myfree_batch frees every block in ptrs with myfree.  NULL entries are skipped.
+*/
+
+void myfree_batch(void *ptrs[], size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        myfree(ptrs[i]);
+    }
+}
+
+/* Function: allocator_stats
+---------------------------------
+allocator_stats returns a copy of stats.  The bitmaps give the highest non-empty list without walking it, so the largest size that list can hold is reported as an upper bound on the largest free block.  A list spans 1/SL_COUNT of a power of two, so the bound is within about 3% of the largest block, and it is never more than free_bytes.  A free list is found without searching, so search_steps stays 0.
+*/
+
+allocator_stats_t allocator_stats() {
+    allocator_stats_t result = stats;
+    result.largest_free = 0;
+    if (fl_bitmap != 0) {
+        int fl = 63 - __builtin_clzl(fl_bitmap);
+        int sl = 31 - __builtin_clz(sl_bitmaps[fl]);
+        if (fl == 0) {
+            result.largest_free = sl * (SMALL_SIZE / SL_COUNT);
+        } else {
+            int log = fl + SMALL_LOG - 1;  // the highest set bit of every size of the level
+            result.largest_free = ((size_t)1 << log) + ((size_t)(sl + 1) << (log - SL_LOG)) - ALIGNMENT;
+        }
+    }
+    // no free block is bigger than all the free bytes together
+    if (result.largest_free > result.free_bytes) {
+        result.largest_free = result.free_bytes;
+    }
+    return result;
+}
+
+/* Function: validate_heap
+---------------------------------
+This function checks the internal structure of the heap by ensuring that all the memory of the heap is accounted for, that every free block has a matching footer and no free neighbour before it, and that each header records correctly whether the block before it is free.  The free lists must contain exactly the free blocks of the heap, each on the list its size maps to, and the bitmaps must mark exactly the non-empty lists and levels.  If any check fails, validate_heap returns false, otherwise it returns true.
+*/
+
+bool validate_heap() {
+    void *temp = segment_start;
+    void *end_heap = (char *)segment_start + segment_size;
+    size_t count = 0;
+    size_t free_blocks = 0;
+    size_t free_bytes = 0;
+    bool last_free = false;
+    while (temp < end_heap) {
+        size_t block_size = get_size(temp) + BLOCK_SIZE;
+        if (block_size < BLOCK_SIZE + MIN_BLOCK || prev_is_free(temp) != last_free) {
+            printf("Bad header at %p\n", temp);
+            breakpoint();
+            return false;
+        }
+        last_free = is_free(temp);
+        if (last_free) {
+            if (prev_is_free(temp) || ((footer *)((char *)temp + get_size(temp)))->size != get_size(temp)) {
+                printf("Free block at %p was not coalesced or has a bad footer\n", temp);
+                breakpoint();
+                return false;
+            }
+            free_blocks++;
+            free_bytes += get_size(temp);
+        }
+        count += block_size;
+        temp = (char *)temp + block_size;
+    }
+    if (count != segment_size) {
+        printf("Blocks cover %zu bytes instead of %zu\n", count, segment_size);
+        breakpoint();
+        return false;
+    }
+    if (free_blocks != stats.free_blocks || free_bytes != stats.free_bytes) {
+        printf("Stats count %zu free blocks of %zu bytes instead of %zu of %zu\n",
+               stats.free_blocks, stats.free_bytes, free_blocks, free_bytes);
+        breakpoint();
+        return false;
+    }
+    size_t listed_blocks = 0;
+    for (int fl = 0; fl < FL_COUNT; fl++) {
+        if (((fl_bitmap >> fl) & 1) != (sl_bitmaps[fl] != 0)) {
+            return false;
+        }
+        for (int sl = 0; sl < SL_COUNT; sl++) {
+            if (((sl_bitmaps[fl] >> sl) & 1) != (free_lists[fl][sl] != NULL)) {
+                return false;
+            }
+            node *prev_node = NULL;
+            for (node *cur = free_lists[fl][sl]; cur != NULL; cur = cur->next) {
+                void *location = (char *)cur - BLOCK_SIZE;
+                int cur_fl, cur_sl;
+                mapping(get_size(location), &cur_fl, &cur_sl);
+                if (location < segment_start || location >= end_heap || !is_free(location) ||
+                    cur_fl != fl || cur_sl != sl || cur->prev != prev_node) {
+                    printf("Bad node %p on free list %d, %d\n", cur, fl, sl);
+                    breakpoint();
+                    return false;
+                }
+                if (++listed_blocks > free_blocks) {
+                    return false;
+                }
+                prev_node = cur;
+            }
+        }
+    }
+    return listed_blocks == free_blocks;
+}
+
+/* Function: dump_heap
+ * -------------------
+ * This function prints out the the block contents of the heap.  For every block, it prints the pointer to the header, a character indicating that it is free or used, the payload size, and the size in hex including the header, followed by the non-empty free lists.  dump_heap is not
+ * called anywhere, but is a useful helper function to call from gdb when
+ * tracing through programs.
+ */
+void dump_heap() {
+    void *temp = segment_start;
+    void *end_heap = (char *)segment_start + segment_size;
+    printf("Heap segment starts at address %p, ends at %p\n", segment_start, end_heap);
+    while (temp < end_heap) {
+        size_t block_len = get_size(temp);
+        printf("%p, %c, %ld, %zx\n", temp, is_free(temp) ? 'f' : 'u', block_len, block_len + BLOCK_SIZE);
+        temp = (char *)temp + BLOCK_SIZE + block_len;
+    }
+    for (int fl = 0; fl < FL_COUNT; fl++) {
+        for (int sl = 0; sl < SL_COUNT; sl++) {
+            if (free_lists[fl][sl] == NULL) {
+                continue;
+            }
+            printf("list %d, %d:", fl, sl);
+            for (node *cur = free_lists[fl][sl]; cur != NULL; cur = cur->next) {
+                printf(" %p", cur);
+            }
+            printf("\n");
+        }
+    }
+}
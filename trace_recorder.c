@@ -0,0 +1,963 @@
+/* File: trace_recorder.c
+ * ----------------------
+ * A library to load into another program with LD_PRELOAD, which records
+ * the heap requests the program makes as a script that test_harness can
+ * replay.  It wraps malloc, calloc, realloc, free, posix_memalign, memalign
+ * and aligned_alloc, passing each call on to the C library and writing a
+ * line in the same format as the sample scripts: `a <id> <size>`, `c <id>
+ * <size>`, `r <id> <size>`, `f <id>` and `m <id> <alignment> <size>`.
+ *
+ * Each block gets an id when it is allocated, which it keeps when it is
+ * reallocated.  The id of a freed block is reused for a later block, so the
+ * number of ids stays close to the most blocks live at once.  Blocks are
+ * found by address in a hash table split into shards with a lock each, so
+ * threads rarely wait for each other.
+ *
+ * A request is only appended to a buffer of the thread that made it, and a
+ * writer thread formats and writes the buffers in the background, so the
+ * program is not slowed down by the file.  Every request gets a sequence
+ * number, and the writer merges the buffers of all threads in that order,
+ * only writing a request once no thread can still add an earlier one.
+ *
+ * Usage: LD_PRELOAD=./libtrace_recorder.so TRACE_FILE=<path> program [args]
+ * Each %p in TRACE_FILE is replaced by the pid, and TRACE_FILE defaults to
+ * trace.%p.script, so programs that the recorded one runs, which inherit
+ * LD_PRELOAD, write traces of their own.  A process does not record if
+ * another one is already recording to the same file.  Requests made before
+ * the library is initialized, by a forked child, or for more than
+ * MAX_REQUEST_SIZE bytes are not recorded, and neither are frees of blocks
+ * that were not.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include "allocator.h"  // for MAX_REQUEST_SIZE
+
+// The C library's own allocator, which the wrappers pass every call on to
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+// number of shards of the table of live blocks, a power of two
+#define NUM_SHARDS 64
+#define SHARD_BITS 6
+
+// slots each shard starts with, a power of two
+#define INITIAL_SLOTS 1024
+
+// requests that fit in one thread's buffer
+#define RECORDS_PER_BUFFER 4096
+
+// how often the writer looks for requests to write if no buffer fills up
+#define FLUSH_INTERVAL_MS 100
+
+// floor of a thread with no request on its way into its buffer
+#define NO_SEQ UINT64_MAX
+
+// Thread-local variables use the initial-exec model so reading them never calls malloc
+#define THREAD_LOCAL __thread __attribute__((tls_model("initial-exec")))
+
+// one recorded request
+typedef struct {
+    uint64_t seq;       // position of the request among the requests of all threads
+    size_t size;        // requested size, unused for a free
+    size_t alignment;   // requested alignment of an `m` request
+    int id;             // id of the block
+    char op;            // the letter that starts the script line
+} record_t;
+
+// buffer of the requests of one thread, written out by the writer once it is queued
+typedef struct buffer {
+    record_t records[RECORDS_PER_BUFFER];
+    _Atomic int count;      // records in the buffer, each published once written
+    int nwritten;           // records the writer has written out
+    struct buffer *next;    // next buffer in the queue, the pending list or the pool
+} buffer_t;
+
+// state of one thread that has made requests, linked into the list of such threads
+typedef struct thread_log {
+    _Atomic(buffer_t *) buffer;  // the buffer the thread appends to
+    _Atomic uint64_t floor;      // no request still on its way into the buffer has a smaller seq, NO_SEQ if there is none
+    struct thread_log *next;
+    struct thread_log *prev;
+} thread_log_t;
+
+// one shard of the table from the address of a live block to its id
+typedef struct {
+    pthread_mutex_t lock;
+    uintptr_t *keys;      // addresses of the blocks, 0 in an empty slot
+    int *ids;             // id of the block in the same slot
+    int bits;             // the shard has 1 << bits slots
+    size_t count;         // slots in use
+    int *free_ids;        // ids freed in this shard, to be reused before new ones
+    size_t nfree;
+    size_t free_capacity;
+} shard_t;
+
+static shard_t shards[NUM_SHARDS];
+static atomic_int next_id;            // next id never used before
+static _Atomic uint64_t next_seq;     // seq of the next request
+static atomic_bool recording;         // whether requests are recorded
+static pid_t recorder_pid;            // the process that is recording, not a forked child
+static int trace_fd = -1;
+
+// thread logs of the threads that have made requests, and the key that retires them when a thread exits
+static pthread_mutex_t logs_lock = PTHREAD_MUTEX_INITIALIZER;
+static thread_log_t *logs = NULL;
+static pthread_key_t log_key;
+
+// full buffers waiting for the writer, oldest first
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_changed = PTHREAD_COND_INITIALIZER;
+static buffer_t *queue_head = NULL;
+static buffer_t *queue_tail = NULL;
+static bool stopping = false;
+
+// buffers the writer has emptied, ready to be handed to a thread again
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static buffer_t *pool = NULL;
+
+// state used only by the writer
+static pthread_t writer;
+static buffer_t *pending = NULL;  // buffers taken from the queue with records still to write
+static buffer_t **sources = NULL; // the buffers a pass of the writer merges
+static size_t sources_capacity = 0;
+static char out[1 << 16];
+static size_t out_len = 0;
+
+static THREAD_LOCAL bool in_recorder;  // set while the recorder itself runs, so its own calls are not recorded
+static THREAD_LOCAL thread_log_t thread_log;
+
+
+/* Function: map_pages
+ * -------------------
+ * Maps size bytes of zeroed memory straight from the OS, so the recorder's
+ * own memory never comes from the allocator it is recording.  Returns NULL
+ * if the mapping fails.
+ */
+static void *map_pages(size_t size) {
+    void *ptr = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    return (ptr == MAP_FAILED) ? NULL : ptr;
+}
+
+/* Function: give_up
+ * -----------------
+ * Stops recording when the recorder runs out of memory, leaving the program
+ * to run on.  The requests recorded so far are still written.
+ */
+static void give_up() {
+    static const char message[] = "trace_recorder: out of memory, recording stopped\n";
+    if (atomic_exchange(&recording, false)) {
+        write(STDERR_FILENO, message, sizeof(message) - 1);
+    }
+}
+
+/* Function: enter, leave
+ * ----------------------
+ * enter returns true if the current request should be recorded, and marks
+ * the thread as inside the recorder until leave is called.  Requests made
+ * while the recorder runs, from pthread functions for example, are passed
+ * on without being recorded.
+ */
+static bool enter() {
+    if (in_recorder || !atomic_load_explicit(&recording, memory_order_relaxed)) {
+        return false;
+    }
+    in_recorder = true;
+    return true;
+}
+
+static void leave() {
+    in_recorder = false;
+}
+
+
+/* THREAD BUFFERS */
+
+
+/* Function: take_buffer
+ * ---------------------
+ * Returns an empty buffer from the pool, or a newly mapped one if the pool
+ * is empty, or NULL if one can't be mapped.
+ */
+static buffer_t *take_buffer() {
+    pthread_mutex_lock(&pool_lock);
+    buffer_t *buffer = pool;
+    if (buffer != NULL) {
+        pool = buffer->next;
+    }
+    pthread_mutex_unlock(&pool_lock);
+    if (buffer == NULL && (buffer = map_pages(sizeof(buffer_t))) == NULL) {
+        return NULL;
+    }
+    atomic_store(&buffer->count, 0);
+    buffer->nwritten = 0;
+    buffer->next = NULL;
+    return buffer;
+}
+
+/* Function: queue_buffer
+ * ----------------------
+ * Hands a buffer that will get no more records to the writer.
+ */
+static void queue_buffer(buffer_t *buffer) {
+    buffer->next = NULL;
+    pthread_mutex_lock(&queue_lock);
+    if (queue_tail != NULL) {
+        queue_tail->next = buffer;
+    } else {
+        queue_head = buffer;
+    }
+    queue_tail = buffer;
+    pthread_cond_signal(&queue_changed);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+/* Function: retire_log
+ * --------------------
+ * Called when a thread that made requests exits.  Queues what is left in
+ * its buffer and takes it out of the list of thread logs, in that order, so
+ * the writer always sees its records in one place or the other.
+ */
+static void retire_log(void *arg) {
+    thread_log_t *log = arg;
+    in_recorder = true;
+    buffer_t *buffer = atomic_exchange(&log->buffer, NULL);
+    if (buffer != NULL) {
+        queue_buffer(buffer);
+    }
+    pthread_mutex_lock(&logs_lock);
+    if (log->prev != NULL) {
+        log->prev->next = log->next;
+    } else {
+        logs = log->next;
+    }
+    if (log->next != NULL) {
+        log->next->prev = log->prev;
+    }
+    pthread_mutex_unlock(&logs_lock);
+}
+
+/* Function: current_log
+ * ---------------------
+ * Returns the log of the calling thread, giving it a buffer and adding it to
+ * the list of thread logs the first time the thread makes a request.
+ * Returns NULL if the thread has no buffer and none can be mapped.
+ */
+static thread_log_t *current_log() {
+    thread_log_t *log = &thread_log;
+    if (atomic_load_explicit(&log->buffer, memory_order_relaxed) != NULL) {
+        return log;
+    }
+    buffer_t *buffer = take_buffer();
+    if (buffer == NULL) {
+        give_up();
+        return NULL;
+    }
+    atomic_store(&log->floor, NO_SEQ);
+    atomic_store(&log->buffer, buffer);
+    pthread_mutex_lock(&logs_lock);
+    log->prev = NULL;
+    log->next = logs;
+    if (logs != NULL) {
+        logs->prev = log;
+    }
+    logs = log;
+    pthread_mutex_unlock(&logs_lock);
+    pthread_setspecific(log_key, log);
+    return log;
+}
+
+/* Function: begin_request
+ * -------------------------
+ * Returns the seq of a new request of the calling thread, which must then be
+ * appended with append_record.  The thread's floor is set before the seq is
+ * taken and cleared once the request is in the buffer, so the writer never
+ * writes a later request while this one is on its way.
+ */
+static uint64_t begin_request(thread_log_t *log) {
+    atomic_store(&log->floor, atomic_load(&next_seq));
+    return atomic_fetch_add(&next_seq, 1);
+}
+
+/* Function: append_record
+ * -----------------------
+ * Appends a request to the calling thread's buffer, where the writer can
+ * read it right away, and hands the buffer to the writer once it is full,
+ * so the buffer a thread holds always has room.
+ */
+static void append_record(thread_log_t *log, record_t record) {
+    buffer_t *buffer = atomic_load_explicit(&log->buffer, memory_order_relaxed);
+    int count = atomic_load_explicit(&buffer->count, memory_order_relaxed);
+    buffer->records[count] = record;
+    atomic_store_explicit(&buffer->count, count + 1, memory_order_release);
+    atomic_store(&log->floor, NO_SEQ);
+    if (count + 1 == RECORDS_PER_BUFFER) {
+        buffer_t *fresh = take_buffer();
+        if (fresh == NULL) {
+            give_up();
+        }
+        // queued before it is swapped out, so the writer finds it in one place or the other
+        queue_buffer(buffer);
+        atomic_store(&log->buffer, fresh);
+    }
+}
+
+
+/* TABLE OF LIVE BLOCKS */
+
+
+/* Function: hash_pointer
+ * ----------------------
+ * Mixes the bits of a block address, whose low bits are always zero.  The
+ * top bits pick the shard and the bits below them the slot.
+ */
+static inline uint64_t hash_pointer(uintptr_t key) {
+    return (uint64_t)(key >> 4) * 0x9E3779B97F4A7C15ULL;
+}
+
+static inline shard_t *shard_of(void *ptr) {
+    return &shards[hash_pointer((uintptr_t)ptr) >> (64 - SHARD_BITS)];
+}
+
+static inline size_t home_slot(shard_t *shard, uintptr_t key) {
+    return (hash_pointer(key) << SHARD_BITS) >> (64 - shard->bits);
+}
+
+/* Function: map_slots
+ * -------------------
+ * Gives the shard an empty table of 1 << bits slots.  Returns false if the
+ * table can't be mapped.
+ */
+static bool map_slots(shard_t *shard, int bits) {
+    size_t nslots = (size_t)1 << bits;
+    uintptr_t *keys = map_pages(nslots * (sizeof(uintptr_t) + sizeof(int)));
+    if (keys == NULL) {
+        return false;
+    }
+    shard->keys = keys;
+    shard->ids = (int *)(keys + nslots);
+    shard->bits = bits;
+    shard->count = 0;
+    return true;
+}
+
+/* Function: put_block
+ * -------------------
+ * Adds a block to the shard, or changes its id if its address is already in
+ * the shard, which happens when a block was freed without being recorded.
+ * The table is doubled when it gets half full, so there is always an empty
+ * slot to end a search.
+ */
+static void put_block(shard_t *shard, uintptr_t key, int id) {
+    if ((shard->count + 1) * 2 > ((size_t)1 << shard->bits)) {
+        uintptr_t *old_keys = shard->keys;
+        int *old_ids = shard->ids;
+        size_t old_nslots = (size_t)1 << shard->bits;
+        if (map_slots(shard, shard->bits + 1)) {
+            for (size_t i = 0; i < old_nslots; i++) {
+                if (old_keys[i] != 0) {
+                    put_block(shard, old_keys[i], old_ids[i]);
+                }
+            }
+            munmap(old_keys, old_nslots * (sizeof(uintptr_t) + sizeof(int)));
+        } else {
+            give_up();  // the table still has room for this block
+        }
+    }
+    size_t mask = ((size_t)1 << shard->bits) - 1;
+    size_t i = home_slot(shard, key);
+    while (shard->keys[i] != 0 && shard->keys[i] != key) {
+        i = (i + 1) & mask;
+    }
+    if (shard->keys[i] == 0) {
+        shard->count++;
+    }
+    shard->keys[i] = key;
+    shard->ids[i] = id;
+}
+
+/* Function: take_block
+ * --------------------
+ * Removes a block from the shard and returns its id, or -1 if the address
+ * is not in the shard.  The blocks after it in the same run of slots are
+ * shifted back into the hole when their home slot allows it, so no search
+ * stops early at it.
+ */
+static int take_block(shard_t *shard, uintptr_t key) {
+    size_t mask = ((size_t)1 << shard->bits) - 1;
+    size_t i = home_slot(shard, key);
+    while (shard->keys[i] != key) {
+        if (shard->keys[i] == 0) {
+            return -1;
+        }
+        i = (i + 1) & mask;
+    }
+    int id = shard->ids[i];
+    for (size_t j = (i + 1) & mask; shard->keys[j] != 0; j = (j + 1) & mask) {
+        size_t home = home_slot(shard, shard->keys[j]);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            shard->keys[i] = shard->keys[j];
+            shard->ids[i] = shard->ids[j];
+            i = j;
+        }
+    }
+    shard->keys[i] = 0;
+    shard->count--;
+    return id;
+}
+
+/* Function: new_id
+ * ----------------
+ * Returns an id freed in the shard if there is one, or an id never used
+ * before.
+ */
+static int new_id(shard_t *shard) {
+    return (shard->nfree > 0) ? shard->free_ids[--shard->nfree] : atomic_fetch_add(&next_id, 1);
+}
+
+/* Function: release_id
+ * --------------------
+ * Keeps the id of a freed block for reuse by the shard.  The stack of freed
+ * ids is doubled when it is full; if that fails the id is simply not reused.
+ */
+static void release_id(shard_t *shard, int id) {
+    if (shard->nfree == shard->free_capacity) {
+        size_t capacity = (shard->free_capacity == 0) ? 1024 : 2 * shard->free_capacity;
+        int *free_ids = map_pages(capacity * sizeof(int));
+        if (free_ids == NULL) {
+            return;
+        }
+        if (shard->free_ids != NULL) {
+            memcpy(free_ids, shard->free_ids, shard->nfree * sizeof(int));
+            munmap(shard->free_ids, shard->free_capacity * sizeof(int));
+        }
+        shard->free_ids = free_ids;
+        shard->free_capacity = capacity;
+    }
+    shard->free_ids[shard->nfree++] = id;
+}
+
+
+/* RECORDING */
+
+
+/* Function: record_alloc
+ * ----------------------
+ * Records that a block was allocated at ptr by a request of type op.  The
+ * block keeps the id passed in, that of the block it was reallocated from,
+ * or gets a new one if id is -1.  The seq is taken while the shard is
+ * locked, so the request comes after the free that last released the id.
+ */
+static void record_alloc(char op, void *ptr, int id, size_t size, size_t alignment) {
+    if (size > MAX_REQUEST_SIZE || !enter()) {
+        return;
+    }
+    thread_log_t *log = current_log();
+    if (log != NULL) {
+        shard_t *shard = shard_of(ptr);
+        pthread_mutex_lock(&shard->lock);
+        if (id < 0) {
+            id = new_id(shard);
+        }
+        put_block(shard, (uintptr_t)ptr, id);
+        uint64_t seq = begin_request(log);
+        pthread_mutex_unlock(&shard->lock);
+        append_record(log, (record_t){.seq = seq, .op = op, .id = id, .size = size, .alignment = alignment});
+    }
+    leave();
+}
+
+/* Function: record_free
+ * ---------------------
+ * Records that the block at ptr is freed, if it was recorded, and lets its
+ * id be reused.  This must be called before the block is given back to the
+ * C library, which may hand the address to another thread at once.
+ */
+static void record_free(void *ptr) {
+    if (!enter()) {
+        return;
+    }
+    thread_log_t *log = current_log();
+    if (log != NULL) {
+        shard_t *shard = shard_of(ptr);
+        pthread_mutex_lock(&shard->lock);
+        int id = take_block(shard, (uintptr_t)ptr);
+        uint64_t seq = 0;
+        if (id >= 0) {
+            seq = begin_request(log);
+            release_id(shard, id);
+        }
+        pthread_mutex_unlock(&shard->lock);
+        if (id >= 0) {
+            append_record(log, (record_t){.seq = seq, .op = 'f', .id = id});
+        }
+    }
+    leave();
+}
+
+/* Function: forget_block
+ * ----------------------
+ * Takes the block at ptr out of the table without recording anything, and
+ * returns its id, or -1 if it is not there.  Used by realloc, which gives
+ * the id to the block it returns.
+ */
+static int forget_block(void *ptr) {
+    if (!enter()) {
+        return -1;
+    }
+    shard_t *shard = shard_of(ptr);
+    pthread_mutex_lock(&shard->lock);
+    int id = take_block(shard, (uintptr_t)ptr);
+    pthread_mutex_unlock(&shard->lock);
+    leave();
+    return id;
+}
+
+/* Function: restore_block
+ * -----------------------
+ * Puts a block taken out by forget_block back, when realloc fails and the
+ * block stays where it was.
+ */
+static void restore_block(void *ptr, int id) {
+    if (id < 0) {
+        return;
+    }
+    bool entered = enter();
+    shard_t *shard = shard_of(ptr);
+    pthread_mutex_lock(&shard->lock);
+    put_block(shard, (uintptr_t)ptr, id);
+    pthread_mutex_unlock(&shard->lock);
+    if (entered) {
+        leave();
+    }
+}
+
+
+/* WRITER */
+
+
+/* Function: format_number
+ * -----------------------
+ * Appends a space and the decimal digits of n to the output buffer.
+ */
+static void format_number(size_t n) {
+    char digits[24];
+    int len = 0;
+    do {
+        digits[len++] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+    out[out_len++] = ' ';
+    while (len > 0) {
+        out[out_len++] = digits[--len];
+    }
+}
+
+/* Function: flush_output
+ * ----------------------
+ * Writes the output buffer to the trace file.
+ */
+static void flush_output() {
+    for (size_t done = 0; done < out_len; ) {
+        ssize_t nwritten = write(trace_fd, out + done, out_len - done);
+        if (nwritten < 0 && errno != EINTR) {
+            break;
+        }
+        done += (nwritten > 0) ? nwritten : 0;
+    }
+    out_len = 0;
+}
+
+/* Function: format_record
+ * -----------------------
+ * Appends the script line for one request to the output buffer, flushing
+ * it first if the line might not fit.
+ */
+static void format_record(const record_t *record) {
+    if (out_len + 64 > sizeof(out)) {
+        flush_output();
+    }
+    out[out_len++] = record->op;
+    format_number(record->id);
+    if (record->op == 'm') {
+        format_number(record->alignment);
+    }
+    if (record->op != 'f') {
+        format_number(record->size);
+    }
+    out[out_len++] = '\n';
+}
+
+/* Function: take_queue
+ * --------------------
+ * Moves the queued buffers to the front of the pending list.
+ */
+static void take_queue() {
+    pthread_mutex_lock(&queue_lock);
+    if (queue_head != NULL) {
+        queue_tail->next = pending;
+        pending = queue_head;
+        queue_head = queue_tail = NULL;
+    }
+    pthread_mutex_unlock(&queue_lock);
+}
+
+/* Function: add_source
+ * --------------------
+ * Adds a buffer to the ones the current pass of the writer merges, unless
+ * it is there already, which happens to a buffer queued during the pass.
+ */
+static void add_source(size_t *pnsources, buffer_t *buffer) {
+    for (size_t i = 0; i < *pnsources; i++) {
+        if (sources[i] == buffer) {
+            return;
+        }
+    }
+    if (*pnsources == sources_capacity) {
+        size_t capacity = (sources_capacity == 0) ? 1024 : 2 * sources_capacity;
+        buffer_t **grown = map_pages(capacity * sizeof(buffer_t *));
+        if (grown == NULL) {
+            give_up();
+            return;
+        }
+        if (sources != NULL) {
+            memcpy(grown, sources, *pnsources * sizeof(buffer_t *));
+            munmap(sources, sources_capacity * sizeof(buffer_t *));
+        }
+        sources = grown;
+        sources_capacity = capacity;
+    }
+    sources[(*pnsources)++] = buffer;
+}
+
+/* Function: front_seq
+ * ---------------------
+ * Returns the seq of the first request of a buffer that is not written yet.
+ */
+static inline uint64_t front_seq(buffer_t *buffer) {
+    return buffer->records[buffer->nwritten].seq;
+}
+
+/* Function: sift_down
+ * -------------------
+ * Moves the buffer at position i of the first nsources sources down until
+ * neither of its children has an earlier front request, so sources stays a
+ * min-heap ordered by front_seq.
+ */
+static void sift_down(size_t nsources, size_t i) {
+    while (2 * i + 1 < nsources) {
+        size_t child = 2 * i + 1;
+        if (child + 1 < nsources && front_seq(sources[child + 1]) < front_seq(sources[child])) {
+            child++;
+        }
+        if (front_seq(sources[i]) <= front_seq(sources[child])) {
+            return;
+        }
+        buffer_t *tmp = sources[i];
+        sources[i] = sources[child];
+        sources[child] = tmp;
+        i = child;
+    }
+}
+
+/* Function: write_records
+ * -----------------------
+ * Writes out, in seq order, every request below the watermark from the
+ * queued buffers and from the buffers the threads are still appending to.
+ * The watermark is next_seq, or the floor of a thread if that is smaller,
+ * so no request that can still show up comes before one that is written.
+ * The current buffers are read after next_seq and the floors, and the
+ * queue after them, so a buffer swapped out in between is found in the
+ * queue.  Every request below the watermark is already in its buffer then,
+ * so the buffers are merged through a heap built once per pass, and a pass
+ * takes O(log n) per request however many buffers have piled up.  At the
+ * end of the program, `final` is set and everything is written.  Queued
+ * buffers that have been written out in full go back to the pool.
+ */
+static void write_records(bool final) {
+    uint64_t watermark = final ? NO_SEQ : atomic_load(&next_seq);
+    size_t nsources = 0;
+    pthread_mutex_lock(&logs_lock);
+    for (thread_log_t *log = logs; log != NULL; log = log->next) {
+        uint64_t floor = atomic_load(&log->floor);
+        if (!final && floor < watermark) {
+            watermark = floor;
+        }
+        buffer_t *buffer = atomic_load(&log->buffer);
+        if (buffer != NULL) {
+            add_source(&nsources, buffer);
+        }
+    }
+    pthread_mutex_unlock(&logs_lock);
+    take_queue();
+    for (buffer_t *buffer = pending; buffer != NULL; buffer = buffer->next) {
+        add_source(&nsources, buffer);
+    }
+
+    // each buffer is in seq order, so the next request is the one at the front of the buffer on top of the heap
+    size_t nheap = 0;
+    for (size_t i = 0; i < nsources; i++) {
+        if (sources[i]->nwritten < atomic_load_explicit(&sources[i]->count, memory_order_acquire)) {
+            sources[nheap++] = sources[i];
+        }
+    }
+    for (size_t i = nheap / 2; i-- > 0; ) {
+        sift_down(nheap, i);
+    }
+    while (nheap > 0 && front_seq(sources[0]) < watermark) {
+        buffer_t *next = sources[0];
+        format_record(&next->records[next->nwritten++]);
+        if (next->nwritten == atomic_load_explicit(&next->count, memory_order_acquire)) {
+            sources[0] = sources[--nheap];
+        }
+        sift_down(nheap, 0);
+    }
+    flush_output();
+
+    // a queued buffer gets no more requests, so once it is written out it can be used again
+    for (buffer_t **link = &pending; *link != NULL; ) {
+        buffer_t *buffer = *link;
+        if (buffer->nwritten == atomic_load(&buffer->count)) {
+            *link = buffer->next;
+            pthread_mutex_lock(&pool_lock);
+            buffer->next = pool;
+            pool = buffer;
+            pthread_mutex_unlock(&pool_lock);
+        } else {
+            link = &buffer->next;
+        }
+    }
+}
+
+/* Function: write_trace
+ * ---------------------
+ * The body of the writer thread.  It writes what it can whenever a buffer
+ * is queued, or every FLUSH_INTERVAL_MS otherwise, until the program ends.
+ */
+static void *write_trace(void *arg) {
+    in_recorder = true;
+    pthread_mutex_lock(&queue_lock);
+    while (!stopping) {
+        if (queue_head == NULL) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += FLUSH_INTERVAL_MS * 1000000L;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&queue_changed, &queue_lock, &deadline);
+        }
+        pthread_mutex_unlock(&queue_lock);
+        write_records(false);
+        pthread_mutex_lock(&queue_lock);
+    }
+    pthread_mutex_unlock(&queue_lock);
+    return NULL;
+}
+
+
+/* SETUP */
+
+
+/* Function: stop_in_child
+ * -----------------------
+ * A forked child has no writer thread, so it does not record.
+ */
+static void stop_in_child() {
+    atomic_store(&recording, false);
+}
+
+/* Function: trace_path
+ * --------------------
+ * Writes the path of the trace file to path: TRACE_FILE with each %p
+ * replaced by the pid, or trace.%p.script if TRACE_FILE is not set.
+ */
+static void trace_path(char path[], size_t size) {
+    const char *pattern = getenv("TRACE_FILE");
+    if (pattern == NULL) {
+        pattern = "trace.%p.script";
+    }
+    size_t len = 0;
+    for (const char *cur = pattern; *cur != '\0' && len + 1 < size; cur++) {
+        if (cur[0] == '%' && cur[1] == 'p') {
+            len += snprintf(path + len, size - len, "%d", (int)getpid());
+            len = (len < size) ? len : size - 1;
+            cur++;
+        } else {
+            path[len++] = *cur;
+        }
+    }
+    path[len] = '\0';
+}
+
+/* Function: start_recording
+ * -------------------------
+ * Runs when the library is loaded.  Opens the trace file, sets up the
+ * shards and starts the writer thread, then turns on recording.
+ */
+__attribute__((constructor)) static void start_recording() {
+    in_recorder = true;
+    char path[4096];
+    trace_path(path, sizeof(path));
+    trace_fd = open(path, O_WRONLY|O_CREAT|O_CLOEXEC, 0644);
+    if (trace_fd < 0) {
+        fprintf(stderr, "trace_recorder: could not open \"%s\", not recording\n", path);
+        in_recorder = false;
+        return;
+    }
+    // a program run by the recorded one inherits TRACE_FILE, and quietly leaves its trace alone
+    if (flock(trace_fd, LOCK_EX|LOCK_NB) != 0) {
+        close(trace_fd);
+        trace_fd = -1;
+        in_recorder = false;
+        return;
+    }
+    ftruncate(trace_fd, 0);
+    for (int i = 0; i < NUM_SHARDS; i++) {
+        pthread_mutex_init(&shards[i].lock, NULL);
+        if (!map_slots(&shards[i], __builtin_ctz(INITIAL_SLOTS))) {
+            fprintf(stderr, "trace_recorder: out of memory, not recording\n");
+            in_recorder = false;
+            return;
+        }
+    }
+    pthread_key_create(&log_key, retire_log);
+    pthread_atfork(NULL, NULL, stop_in_child);
+    if (pthread_create(&writer, NULL, write_trace, NULL) != 0) {
+        fprintf(stderr, "trace_recorder: could not start the writer, not recording\n");
+        in_recorder = false;
+        return;
+    }
+    recorder_pid = getpid();
+    atomic_store(&recording, true);
+    in_recorder = false;
+}
+
+/* Function: stop_recording
+ * ------------------------
+ * Runs when the program exits.  Turns off recording, stops the writer and
+ * writes out every request still in a buffer.  Requests other threads make
+ * from here on are not recorded.
+ */
+__attribute__((destructor)) static void stop_recording() {
+    if (trace_fd < 0 || getpid() != recorder_pid) {
+        return;
+    }
+    in_recorder = true;
+    atomic_store(&recording, false);
+    pthread_mutex_lock(&queue_lock);
+    stopping = true;
+    pthread_cond_signal(&queue_changed);
+    pthread_mutex_unlock(&queue_lock);
+    pthread_join(writer, NULL);
+    write_records(true);
+    close(trace_fd);
+    trace_fd = -1;
+}
+
+
+/* WRAPPERS */
+
+
+void *malloc(size_t size) {
+    void *ptr = __libc_malloc(size);
+    if (ptr != NULL) {
+        record_alloc('a', ptr, -1, size, 0);
+    }
+    return ptr;
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    void *ptr = __libc_calloc(nmemb, size);
+    if (ptr != NULL) {
+        record_alloc('c', ptr, -1, nmemb * size, 0);  // calloc fails if the product overflows
+    }
+    return ptr;
+}
+
+void free(void *ptr) {
+    if (ptr != NULL) {
+        record_free(ptr);
+    }
+    __libc_free(ptr);
+}
+
+/* Function: realloc
+ * -----------------
+ * The block keeps its id, so the block is taken out of the table before the
+ * C library can free its old address, and put back under its new address.
+ * realloc of NULL is recorded as a malloc, realloc to size 0, which frees
+ * the block, as a free, and realloc of a block that was never recorded as a
+ * new block.
+ */
+void *realloc(void *old_ptr, size_t new_size) {
+    if (old_ptr == NULL) {
+        return malloc(new_size);
+    }
+    if (new_size == 0) {
+        free(old_ptr);
+        return NULL;
+    }
+    int id = forget_block(old_ptr);
+    void *new_ptr = __libc_realloc(old_ptr, new_size);
+    if (new_ptr == NULL) {
+        restore_block(old_ptr, id);
+    } else if (new_size > MAX_REQUEST_SIZE && id >= 0) {
+        // the block is too big to replay, so it is recorded as freed
+        restore_block(new_ptr, id);
+        record_free(new_ptr);
+    } else {
+        record_alloc((id >= 0) ? 'r' : 'a', new_ptr, id, new_size, 0);
+    }
+    return new_ptr;
+}
+
+/* Function: memalign_recorded
+ * ---------------------------
+ * Shared by the aligned allocation functions.  A request with an alignment
+ * that is not a power of two is recorded as a malloc.
+ */
+static void *memalign_recorded(size_t alignment, size_t size) {
+    void *ptr = __libc_memalign(alignment, size);
+    if (ptr != NULL) {
+        if (alignment != 0 && (alignment & (alignment - 1)) == 0) {
+            record_alloc('m', ptr, -1, size, alignment);
+        } else {
+            record_alloc('a', ptr, -1, size, 0);
+        }
+    }
+    return ptr;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment % sizeof(void *) != 0) {
+        return EINVAL;
+    }
+    void *ptr = memalign_recorded(alignment, size);
+    if (ptr == NULL) {
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+void *memalign(size_t alignment, size_t size) {
+    return memalign_recorded(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    return memalign_recorded(alignment, size);
+}